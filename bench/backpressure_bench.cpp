@@ -0,0 +1,51 @@
+#include "bench_support.hpp"
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// A quarter as many ramps as workers, each delivering every turn, against workers taking
+// 8 turns per package: the first layer receives far more than it can process.
+FactoryShapeOptions overloaded_plant(std::size_t worker_capacity) {
+    FactoryShapeOptions options = bench_shape(4096);
+    options.ramps = options.workers / 4;
+    options.processing_time = 8;
+    options.worker_capacity = worker_capacity;
+    return options;
+}
+
+
+// Runs the plant in a child process, so that its peak RSS (ru_maxrss) is not that of whatever
+// ran before in this one; the child starts from this process, which adds a few megabytes.
+void BM_OverloadedPlantPeakRss(benchmark::State& state) {
+    FactoryShapeOptions options = overloaded_plant(static_cast<std::size_t>(state.range(0)));
+    auto turns = static_cast<TimeOffset>(state.range(1));
+    generated_structure_file(options);
+    long peak_rss_kb = 0;
+    for (auto _ : state) {
+        pid_t child = ::fork();
+        if (child < 0) {
+            state.SkipWithError("fork failed");
+            break;
+        }
+        if (child == 0) {
+            Factory factory = load_generated_factory(options);
+            run_turns(factory, 1, turns);
+            ::_exit(0);
+        }
+        int status = 0;
+        rusage usage{};
+        if (::wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            state.SkipWithError("the simulation process failed");
+            break;
+        }
+        peak_rss_kb = usage.ru_maxrss;
+    }
+    state.counters["peak_rss_mb"] = static_cast<double>(peak_rss_kb) / 1024;
+}
+BENCHMARK(BM_OverloadedPlantPeakRss)->ArgsProduct({{0, 16}, {2000, 8000}})->ArgNames({"capacity", "turns"})
+    ->Iterations(1)->UseRealTime()->Unit(benchmark::kSecond);
+
+}
@@ -0,0 +1,86 @@
+#include "bench_support.hpp"
+#include "structure_parser.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <tuple>
+#include <unistd.h>
+
+namespace {
+
+class GeneratedFiles {
+public:
+    GeneratedFiles() = default;
+    GeneratedFiles(const GeneratedFiles&) = delete;
+    GeneratedFiles& operator=(const GeneratedFiles&) = delete;
+
+    ~GeneratedFiles() {
+        for (const auto& [key, path] : paths_) {
+            std::remove(path.c_str());
+        }
+    }
+
+    const std::string& get(const FactoryShapeOptions& options) {
+        auto key = std::make_tuple(static_cast<int>(options.shape), options.ramps, options.workers, options.storehouses, options.depth,
+                                   options.fan_out, options.cycle_probability, options.delivery_interval.to_string(),
+                                   options.processing_time.to_string(), static_cast<int>(options.queue_type), options.worker_capacity, options.seed);
+        auto found = paths_.find(key);
+        if (found != paths_.end()) {
+            return found->second;
+        }
+        std::string path = (std::filesystem::temp_directory_path()
+                            / ("netsim_bench_" + std::to_string(::getpid()) + "_" + std::to_string(paths_.size()) + ".txt")).string();
+        generate_factory_structure_file(options, path);
+        return paths_.emplace(key, path).first->second;
+    }
+
+private:
+    using Key = std::tuple<int, std::size_t, std::size_t, std::size_t, std::size_t, std::size_t, double, std::string, std::string, int, std::size_t, std::uint64_t>;
+    std::map<Key, std::string> paths_;
+};
+
+}
+
+
+FactoryShapeOptions bench_shape(std::size_t workers, FactoryShape shape) {
+    FactoryShapeOptions options;
+    options.shape = shape;
+    options.workers = workers;
+    options.ramps = std::max<std::size_t>(1, workers / 64);
+    options.storehouses = std::max<std::size_t>(1, workers / 256);
+    options.depth = 8;
+    options.fan_out = 2;
+    return options;
+}
+
+
+const std::string& generated_structure_file(const FactoryShapeOptions& options) {
+    static GeneratedFiles files;
+    return files.get(options);
+}
+
+
+Factory load_generated_factory(const FactoryShapeOptions& options, std::shared_ptr<FactoryMemory> memory) {
+    Factory factory = load_factory_structure_file(generated_structure_file(options), std::move(memory));
+    factory.set_random_seed(options.seed);
+    factory.set_routing_seed(options.seed);
+    return factory;
+}
+
+
+std::size_t node_count(const Factory& factory) {
+    return static_cast<std::size_t>(std::distance(factory.ramp_cbegin(), factory.ramp_cend())
+                                    + std::distance(factory.worker_cbegin(), factory.worker_cend())
+                                    + std::distance(factory.storehouse_cbegin(), factory.storehouse_cend()));
+}
+
+
+Time run_turns(Factory& factory, Time first_turn, TimeOffset d) {
+    for (Time t = first_turn; t < first_turn + d; ++t) {
+        factory.do_deliveries(t);
+        factory.do_package_passing();
+        factory.do_work(t);
+    }
+    return first_turn + d;
+}
@@ -0,0 +1,25 @@
+#ifndef BENCH_SUPPORT_HPP
+#define BENCH_SUPPORT_HPP
+
+#include "factory.hpp"
+#include "factory_generator.hpp"
+#include <cstddef>
+#include <string>
+
+// The plants the benchmarks run on: one ramp per 64 workers and one storehouse per 256, so that
+// the work per turn grows with the number of workers.
+FactoryShapeOptions bench_shape(std::size_t workers, FactoryShape shape = FactoryShape::LAYERED);
+
+// A structure file generated from the options, written once per process into the temporary
+// directory and removed at exit.
+const std::string& generated_structure_file(const FactoryShapeOptions& options);
+
+// The generated structure, with the routing and duration streams seeded so that runs repeat.
+Factory load_generated_factory(const FactoryShapeOptions& options, std::shared_ptr<FactoryMemory> memory = nullptr);
+
+std::size_t node_count(const Factory& factory);
+
+// Runs turns first_turn .. first_turn + d - 1 without the consistency check of simulate().
+Time run_turns(Factory& factory, Time first_turn, TimeOffset d);
+
+#endif //BENCH_SUPPORT_HPP
@@ -0,0 +1,64 @@
+#include "bench_support.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+// Every link of a plant of some 10k nodes, in the order of its senders.
+std::vector<ReceiverHandle> linked_receivers(const Factory& factory) {
+    std::vector<ReceiverHandle> receivers;
+    auto add_links = [&receivers](const ReceiverPreferences& preferences) {
+        for (const auto& [receiver, probability] : preferences) {
+            receivers.emplace_back(receiver);
+        }
+    };
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        add_links(it->receiver_preferences_);
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        add_links(it->receiver_preferences_);
+    }
+    return receivers;
+}
+
+
+void clear_receivers(Factory& factory) {
+    for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+        it->get_queue()->clear();
+    }
+    for (auto it = factory.storehouse_begin(); it != factory.storehouse_end(); ++it) {
+        it->get_stockpile()->clear();
+    }
+}
+
+
+// One package sent over every link per iteration; items are packages.
+template<typename Send>
+void send_over_links(benchmark::State& state, Send&& send) {
+    Factory factory = load_generated_factory(bench_shape(10000));
+    std::vector<ReceiverHandle> receivers = linked_receivers(factory);
+    for (auto _ : state) {
+        for (const auto& receiver : receivers) {
+            send(receiver, Package());
+        }
+        state.PauseTiming();
+        clear_receivers(factory);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * receivers.size()));
+}
+
+
+void BM_SendReceiverHandle(benchmark::State& state) {
+    send_over_links(state, [](const ReceiverHandle& receiver, Package&& package) { receiver.receive_package(std::move(package)); });
+}
+BENCHMARK(BM_SendReceiverHandle)->Unit(benchmark::kMicrosecond);
+
+
+// The virtual call that passing made before receivers were resolved at link time.
+void BM_SendVirtual(benchmark::State& state) {
+    send_over_links(state, [](const ReceiverHandle& receiver, Package&& package) { receiver.get()->receive_package(std::move(package)); });
+}
+BENCHMARK(BM_SendVirtual)->Unit(benchmark::kMicrosecond);
+
+}
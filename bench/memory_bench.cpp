@@ -0,0 +1,21 @@
+#include "bench_support.hpp"
+#include "factory_memory.hpp"
+#include <benchmark/benchmark.h>
+#include <memory>
+
+namespace {
+
+// Load, a million turns and teardown of a small plant, with its nodes and queues on the global
+// heap (arena:0) or in a FactoryMemory (arena:1).
+void BM_LoadRunTeardown(benchmark::State& state) {
+    FactoryShapeOptions options = bench_shape(static_cast<std::size_t>(state.range(1)));
+    // written before the timed loop
+    generated_structure_file(options);
+    for (auto _ : state) {
+        Factory factory = load_generated_factory(options, state.range(0) ? std::make_shared<FactoryMemory>() : nullptr);
+        run_turns(factory, 1, 1000000);
+    }
+}
+BENCHMARK(BM_LoadRunTeardown)->ArgsProduct({{0, 1}, {64, 512}})->ArgNames({"arena", "workers"})->Unit(benchmark::kSecond);
+
+}
@@ -0,0 +1,20 @@
+#include "package.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+// Creating and destroying a package while `live` others exist, as ramps and storehouses do.
+void BM_PackageAllocation(benchmark::State& state) {
+    std::vector<Package> live(static_cast<std::size_t>(state.range(0)));
+    std::size_t next = 0;
+    for (auto _ : state) {
+        live[next] = Package();
+        benchmark::DoNotOptimize(live[next].get_id());
+        next = next + 1 == live.size() ? 0 : next + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PackageAllocation)->ArgName("live")->RangeMultiplier(10)->Range(1000, 10000000);
+
+}
@@ -0,0 +1,75 @@
+#include "package_id_allocator.hpp"
+#include <benchmark/benchmark.h>
+#include <set>
+#include <vector>
+
+namespace {
+
+// The scheme Package used before PackageIDAllocator: the active and the released IDs in two
+// std::sets, the lowest released ID first, otherwise one past the highest active one.
+class SetIDPool {
+public:
+    ElementID acquire() {
+        ElementID id = 1;
+        if (!available_.empty()) {
+            id = *available_.begin();
+            available_.erase(available_.begin());
+        } else if (!active_.empty()) {
+            id = *active_.rbegin() + 1;
+        }
+        active_.insert(id);
+        return id;
+    }
+
+    void release(ElementID id) {
+        available_.insert(id);
+        active_.erase(id);
+    }
+
+private:
+    std::set<ElementID> active_;
+    std::set<ElementID> available_;
+};
+
+
+// Releases the oldest of `live` IDs and acquires a new one, so that the pool stays at its size.
+template<typename Pool>
+void churn(benchmark::State& state, Pool& pool) {
+    std::vector<ElementID> live(static_cast<std::size_t>(state.range(0)));
+    for (auto& id : live) {
+        id = pool.acquire();
+    }
+    std::size_t next = 0;
+    for (auto _ : state) {
+        pool.release(live[next]);
+        live[next] = pool.acquire();
+        benchmark::DoNotOptimize(live[next]);
+        next = next + 1 == live.size() ? 0 : next + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+
+void BM_AllocatorAnyFree(benchmark::State& state) {
+    PackageIDAllocator allocator(IDReusePolicy::ANY_FREE);
+    churn(state, allocator);
+}
+BENCHMARK(BM_AllocatorAnyFree)->ArgName("live")->RangeMultiplier(10)->Range(1000, 100000000);
+
+
+void BM_AllocatorLowestFree(benchmark::State& state) {
+    PackageIDAllocator allocator(IDReusePolicy::LOWEST_FREE);
+    churn(state, allocator);
+}
+BENCHMARK(BM_AllocatorLowestFree)->ArgName("live")->RangeMultiplier(10)->Range(1000, 100000000);
+
+
+// Capped at 10^7 live IDs: the two sets take some 40 bytes per ID, and 10^8 would not fit
+// in the memory of a typical benchmark machine.
+void BM_SetIDPool(benchmark::State& state) {
+    SetIDPool pool;
+    churn(state, pool);
+}
+BENCHMARK(BM_SetIDPool)->ArgName("live")->RangeMultiplier(10)->Range(1000, 10000000);
+
+}
@@ -0,0 +1,67 @@
+#include "distributions.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+TimeDistribution distribution_of(TimeDistributionType type) {
+    switch (type) {
+        case TimeDistributionType::FIXED:
+            return TimeDistribution(4);
+        case TimeDistributionType::EXPONENTIAL:
+            return TimeDistribution::exponential(4);
+        case TimeDistributionType::UNIFORM:
+            return TimeDistribution::uniform(2, 6);
+        case TimeDistributionType::NORMAL:
+            return TimeDistribution::normal(4, 1.5);
+        case TimeDistributionType::EMPIRICAL:
+            break;
+    }
+    return TimeDistribution::empirical({{1, 0.1}, {2, 0.2}, {4, 0.4}, {6, 0.2}, {10, 0.1}});
+}
+
+
+void every_distribution(benchmark::internal::Benchmark* benchmark) {
+    for (auto type : {TimeDistributionType::FIXED, TimeDistributionType::EXPONENTIAL, TimeDistributionType::UNIFORM,
+                      TimeDistributionType::NORMAL, TimeDistributionType::EMPIRICAL}) {
+        benchmark->Arg(static_cast<std::int64_t>(type));
+    }
+    benchmark->ArgName("type");
+}
+
+
+// One uniform at a time, as a scalar generator would be used.
+void BM_CounterRngScalar(benchmark::State& state) {
+    CounterRng rng(1, 0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rng());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CounterRngScalar);
+
+
+void BM_CounterRngFill(benchmark::State& state) {
+    CounterRng rng(1, 0);
+    std::vector<double> uniforms(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        rng.fill(uniforms.data(), uniforms.size());
+        benchmark::DoNotOptimize(uniforms.data());
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * uniforms.size()));
+}
+BENCHMARK(BM_CounterRngFill)->ArgName("block")->Arg(DurationSampler::BLOCK_SIZE)->Arg(1024);
+
+
+// Durations as workers and ramps draw them, a block refilled every BLOCK_SIZE draws.
+void BM_DurationSampler(benchmark::State& state) {
+    DurationSampler sampler(distribution_of(static_cast<TimeDistributionType>(state.range(0))), 0);
+    sampler.seed(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(sampler.next());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DurationSampler)->Apply(every_distribution);
+
+}
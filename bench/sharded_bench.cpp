@@ -0,0 +1,56 @@
+#include "bench_support.hpp"
+#include "partition.hpp"
+#include "sharded_simulation.hpp"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <thread>
+
+namespace {
+
+// Long enough that the turns, not the fork and the transfer of the shards' states, dominate a call.
+constexpr TimeOffset TURNS_PER_CALL = 50;
+
+// A generated plant of about a million nodes run in one process (shards:0) or split across forked shard
+// processes; the partition is computed once, outside the timed loop.
+void BM_ShardedScaling(benchmark::State& state) {
+    Factory factory = load_generated_factory(bench_shape(1 << 20));
+    auto shards = static_cast<std::size_t>(state.range(0));
+    FactoryPartition partition = shards ? partition_factory(factory, shards) : FactoryPartition();
+    Time t = 1;
+    for (auto _ : state) {
+        if (shards) {
+            simulate_sharded(factory, TURNS_PER_CALL, partition, t);
+            t += TURNS_PER_CALL;
+        } else {
+            t = run_turns(factory, t, TURNS_PER_CALL);
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * TURNS_PER_CALL * node_count(factory)));
+    state.counters["cut_links"] = static_cast<double>(partition.cut_links);
+}
+
+
+// A call of no turns: forking the shards, sending their states back and restoring the plant from
+// them - the fixed cost of every simulate_sharded call.
+void BM_ShardedSetupAndTransfer(benchmark::State& state) {
+    Factory factory = load_generated_factory(bench_shape(1 << 20));
+    FactoryPartition partition = partition_factory(factory, static_cast<std::size_t>(state.range(0)));
+    // with packages in the queues, as after a call that has run turns
+    simulate_sharded(factory, TURNS_PER_CALL, partition);
+    for (auto _ : state) {
+        simulate_sharded(factory, 0, partition, TURNS_PER_CALL + 1);
+    }
+}
+
+
+// 1, 2, 4 .. shards up to the number of cores (at least 2, to measure the exchange between shards).
+void shard_counts(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgName("shards");
+    for (std::int64_t shards = 1; shards <= std::max<std::int64_t>(2, std::thread::hardware_concurrency()); shards *= 2) {
+        benchmark->Arg(shards);
+    }
+}
+BENCHMARK(BM_ShardedScaling)->Arg(0)->Apply(shard_counts)->Iterations(3)->UseRealTime()->Unit(benchmark::kSecond);
+BENCHMARK(BM_ShardedSetupAndTransfer)->Apply(shard_counts)->Iterations(3)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+}
@@ -0,0 +1,35 @@
+#include "bench_support.hpp"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// Cost of one turn of the tick engine; items are nodes, so items/s is node-turns per second.
+void BM_SimulationTurn(benchmark::State& state) {
+    Factory factory = load_generated_factory(bench_shape(static_cast<std::size_t>(state.range(0))));
+    // past the start-up, so that the queues have reached their steady state
+    Time t = run_turns(factory, 1, 64);
+    for (auto _ : state) {
+        t = run_turns(factory, t, 1);
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * node_count(factory)));
+}
+BENCHMARK(BM_SimulationTurn)->ArgName("workers")->RangeMultiplier(8)->Range(1 << 9, 1 << 18)->Unit(benchmark::kMicrosecond);
+
+
+// The same turn with workers run by a pool of 1 .. hardware_concurrency threads (wall-clock time).
+void BM_SimulationTurnThreads(benchmark::State& state) {
+    Factory factory = load_generated_factory(bench_shape(1 << 16));
+    factory.set_thread_pool(std::make_shared<ThreadPool>(static_cast<std::size_t>(state.range(0))));
+    Time t = run_turns(factory, 1, 64);
+    for (auto _ : state) {
+        t = run_turns(factory, t, 1);
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * node_count(factory)));
+}
+BENCHMARK(BM_SimulationTurnThreads)->ArgName("threads")->RangeMultiplier(2)
+    ->Range(1, std::max<std::int64_t>(1, std::thread::hardware_concurrency()))->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+}
@@ -0,0 +1,73 @@
+#include "bench_support.hpp"
+#include "structure_parser.hpp"
+#include "structure_writer.hpp"
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+namespace {
+
+// Arguments: shape, number of workers.
+void shapes_and_sizes(benchmark::internal::Benchmark* benchmark) {
+    for (auto shape : {FactoryShape::LAYERED, FactoryShape::FAN_OUT, FactoryShape::CHAIN, FactoryShape::RANDOM_GRAPH}) {
+        for (std::int64_t workers : {1 << 10, 1 << 14, 1 << 18}) {
+            benchmark->Args({static_cast<std::int64_t>(shape), workers});
+        }
+    }
+    benchmark->ArgNames({"shape", "workers"})->Unit(benchmark::kMillisecond);
+}
+
+FactoryShapeOptions shape_of(const benchmark::State& state) {
+    return bench_shape(static_cast<std::size_t>(state.range(1)), static_cast<FactoryShape>(state.range(0)));
+}
+
+
+void BM_ParseStructure(benchmark::State& state) {
+    const std::string& path = generated_structure_file(shape_of(state));
+    std::size_t nodes = 0;
+    for (auto _ : state) {
+        Factory factory = load_factory_structure_file(path);
+        nodes = node_count(factory);
+        state.PauseTiming();
+        {
+            Factory destroyed = std::move(factory);
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * nodes));
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * std::filesystem::file_size(path)));
+}
+BENCHMARK(BM_ParseStructure)->Apply(shapes_and_sizes);
+
+
+// A structure file of a few hundred megabytes, parsed once per run.
+BENCHMARK(BM_ParseStructure)->Args({static_cast<std::int64_t>(FactoryShape::LAYERED), 1 << 21})->ArgNames({"shape", "workers"})
+    ->Iterations(1)->Unit(benchmark::kSecond);
+
+
+void BM_CheckConsistency(benchmark::State& state) {
+    Factory factory = load_generated_factory(shape_of(state));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(factory.is_consistent());
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * node_count(factory)));
+}
+BENCHMARK(BM_CheckConsistency)->Apply(shapes_and_sizes);
+
+
+void BM_SaveStructure(benchmark::State& state) {
+    Factory factory = load_generated_factory(shape_of(state));
+    int fd = ::open("/dev/null", O_WRONLY);
+    for (auto _ : state) {
+        save_factory_structure_fd(factory, fd);
+    }
+    ::close(fd);
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * node_count(factory)));
+}
+BENCHMARK(BM_SaveStructure)->Apply(shapes_and_sizes);
+// against BM_ParseStructure on the same few-hundred-megabyte structure
+BENCHMARK(BM_SaveStructure)->Args({static_cast<std::int64_t>(FactoryShape::LAYERED), 1 << 21})->ArgNames({"shape", "workers"})
+    ->Iterations(1)->Unit(benchmark::kSecond);
+
+}
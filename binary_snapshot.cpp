@@ -0,0 +1,311 @@
+#include "binary_snapshot.hpp"
+#include "structure_parser.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct SnapshotLayout {
+    std::size_t ramps;
+    std::size_t workers;
+    std::size_t storehouses;
+    std::size_t offsets;
+    std::size_t weights;
+    std::size_t targets;
+    std::size_t bins;
+    std::size_t total;
+};
+
+std::size_t align8(std::size_t offset) {
+    return (offset + 7) & ~std::size_t(7);
+}
+
+SnapshotLayout layout_of(const SnapshotHeader& header) {
+    SnapshotLayout layout {};
+    layout.ramps = align8(sizeof(SnapshotHeader));
+    layout.workers = align8(layout.ramps + header.ramp_count * sizeof(RampRecord));
+    layout.storehouses = align8(layout.workers + header.worker_count * sizeof(WorkerRecord));
+    layout.offsets = align8(layout.storehouses + header.storehouse_count * sizeof(StorehouseRecord));
+    layout.weights = align8(layout.offsets + (header.ramp_count + header.worker_count + 1) * sizeof(std::uint64_t));
+    layout.targets = align8(layout.weights + header.edge_count * sizeof(double));
+    layout.bins = align8(layout.targets + header.edge_count * sizeof(std::uint32_t));
+    layout.total = layout.bins + header.bin_count * sizeof(EmpiricalBinRecord);
+    return layout;
+}
+
+[[noreturn]] void corrupt_snapshot(const std::string& reason) {
+    throw std::runtime_error("Niepoprawny plik migawki: " + reason);
+}
+
+TimeDistributionRecord record_of(const TimeDistribution& distribution, std::vector<EmpiricalBinRecord>& bins) {
+    TimeDistributionRecord record {};
+    record.type = static_cast<std::uint8_t>(distribution.get_type());
+    record.a = distribution.get_a();
+    record.b = distribution.get_b();
+    record.bin_begin = static_cast<std::uint32_t>(bins.size());
+    record.bin_count = static_cast<std::uint32_t>(distribution.get_bins().size());
+    for (const auto& bin : distribution.get_bins()) {
+        EmpiricalBinRecord bin_record {};
+        bin_record.value = bin.value;
+        bin_record.weight = bin.weight;
+        bins.push_back(bin_record);
+    }
+    return record;
+}
+
+TimeDistribution distribution_of(const TimeDistributionRecord& record, TimeOffset fixed, const EmpiricalBinRecord* bins, std::uint64_t bin_count) {
+    try {
+        switch (static_cast<TimeDistributionType>(record.type)) {
+            case TimeDistributionType::FIXED:
+                if (fixed < 1) {
+                    corrupt_snapshot("czas krótszy niż jedna tura");
+                }
+                return TimeDistribution(fixed);
+            case TimeDistributionType::EXPONENTIAL:
+                return TimeDistribution::exponential(record.a);
+            case TimeDistributionType::UNIFORM:
+                return TimeDistribution::uniform(static_cast<TimeOffset>(record.a), static_cast<TimeOffset>(record.b));
+            case TimeDistributionType::NORMAL:
+                return TimeDistribution::normal(record.a, record.b);
+            case TimeDistributionType::EMPIRICAL: {
+                if (record.bin_begin > bin_count || record.bin_count > bin_count - record.bin_begin) {
+                    corrupt_snapshot("przedziały rozkładu poza tablicą");
+                }
+                std::vector<EmpiricalBin> distribution_bins;
+                for (std::uint32_t i = record.bin_begin; i < record.bin_begin + record.bin_count; ++i) {
+                    distribution_bins.push_back({bins[i].value, bins[i].weight});
+                }
+                return TimeDistribution::empirical(std::move(distribution_bins));
+            }
+        }
+    } catch (const std::invalid_argument& e) {
+        corrupt_snapshot(e.what());
+    }
+    corrupt_snapshot("nieznany rozkład czasu");
+}
+
+template<typename Record>
+const Record* section_at(const unsigned char* bytes, std::size_t offset) {
+    return reinterpret_cast<const Record*>(bytes + offset);
+}
+
+template<typename Record>
+void write_section(std::ostream& output_stream, std::size_t& written, std::size_t offset, const std::vector<Record>& records) {
+    static const char zeros[8] = {};
+    output_stream.write(zeros, static_cast<std::streamsize>(offset - written));
+    output_stream.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+    written = offset + records.size() * sizeof(Record);
+}
+
+}
+
+
+void save_factory_snapshot(const Factory& factory, std::ostream& output_stream) {
+    std::vector<RampRecord> ramps;
+    std::vector<WorkerRecord> workers;
+    std::vector<StorehouseRecord> storehouses;
+    std::vector<EmpiricalBinRecord> bins;
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> receiver_index;
+
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        receiver_index[&*it] = static_cast<std::uint32_t>(workers.size());
+        WorkerRecord record {};
+        record.id = it->get_id();
+        record.processing_time = it->get_processing_duration();
+        record.queue_type = static_cast<std::uint8_t>(it->get_queue()->get_queue_type());
+        record.queue_backend = static_cast<std::uint8_t>(it->get_queue()->get_queue_backend());
+        record.capacity = static_cast<std::uint32_t>(it->get_capacity());
+        record.servers = static_cast<std::uint32_t>(it->get_servers());
+        record.processing_distribution = record_of(it->get_processing_time_distribution(), bins);
+        workers.push_back(record);
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        receiver_index[&*it] = static_cast<std::uint32_t>(workers.size() + storehouses.size());
+        storehouses.push_back({it->get_id(), static_cast<std::uint32_t>(it->get_capacity())});
+    }
+
+    std::vector<std::uint64_t> offsets {0};
+    std::vector<double> weights;
+    std::vector<std::uint32_t> targets;
+    auto add_edges = [&](const PackageSender& sender) {
+        for (const auto& [receiver, weight] : sender.receiver_preferences_.get_weights()) {
+            weights.push_back(weight);
+            targets.push_back(receiver_index.at(receiver));
+        }
+        offsets.push_back(targets.size());
+    };
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        RampRecord record {};
+        record.id = it->get_id();
+        record.delivery_interval = it->get_delivery_interval();
+        record.delivery_distribution = record_of(it->get_delivery_interval_distribution(), bins);
+        ramps.push_back(record);
+        add_edges(*it);
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        add_edges(*it);
+    }
+
+    SnapshotHeader header {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.header_size = sizeof(SnapshotHeader);
+    header.ramp_count = ramps.size();
+    header.worker_count = workers.size();
+    header.storehouse_count = storehouses.size();
+    header.edge_count = targets.size();
+    header.bin_count = bins.size();
+    SnapshotLayout layout = layout_of(header);
+
+    output_stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::size_t written = sizeof(header);
+    write_section(output_stream, written, layout.ramps, ramps);
+    write_section(output_stream, written, layout.workers, workers);
+    write_section(output_stream, written, layout.storehouses, storehouses);
+    write_section(output_stream, written, layout.offsets, offsets);
+    write_section(output_stream, written, layout.weights, weights);
+    write_section(output_stream, written, layout.targets, targets);
+    write_section(output_stream, written, layout.bins, bins);
+    output_stream.flush();
+}
+
+
+Factory load_factory_snapshot(const void* data, std::size_t size, std::shared_ptr<FactoryMemory> memory) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    if (size < sizeof(SnapshotHeader)) {
+        corrupt_snapshot("za krótki nagłówek");
+    }
+
+    SnapshotHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        corrupt_snapshot("zła sygnatura");
+    }
+    if (header.version != SNAPSHOT_VERSION || header.header_size != sizeof(SnapshotHeader)) {
+        corrupt_snapshot("nieobsługiwana wersja " + std::to_string(header.version));
+    }
+    if (header.ramp_count > size || header.worker_count > size || header.storehouse_count > size || header.edge_count > size || header.bin_count > size) {
+        corrupt_snapshot("niespójne rozmiary sekcji");
+    }
+    SnapshotLayout layout = layout_of(header);
+    if (layout.total > size) {
+        corrupt_snapshot("plik jest obcięty");
+    }
+
+    const auto* ramps = section_at<RampRecord>(bytes, layout.ramps);
+    const auto* workers = section_at<WorkerRecord>(bytes, layout.workers);
+    const auto* storehouses = section_at<StorehouseRecord>(bytes, layout.storehouses);
+    const auto* offsets = section_at<std::uint64_t>(bytes, layout.offsets);
+    const auto* weights = section_at<double>(bytes, layout.weights);
+    const auto* targets = section_at<std::uint32_t>(bytes, layout.targets);
+    const auto* bins = section_at<EmpiricalBinRecord>(bytes, layout.bins);
+
+    Factory factory(std::move(memory));
+    std::vector<IPackageReceiver*> receivers;
+    receivers.reserve(header.worker_count + header.storehouse_count);
+    std::vector<PackageSender*> senders;
+    senders.reserve(header.ramp_count + header.worker_count);
+
+    for (std::uint64_t i = 0; i < header.ramp_count; ++i) {
+        factory.add_ramp(Ramp(ramps[i].id, distribution_of(ramps[i].delivery_distribution, ramps[i].delivery_interval, bins, header.bin_count)));
+        senders.push_back(&*factory.find_ramp_by_id(ramps[i].id));
+    }
+    for (std::uint64_t i = 0; i < header.worker_count; ++i) {
+        const WorkerRecord& record = workers[i];
+        if (record.queue_type > static_cast<std::uint8_t>(PackageQueueType::LIFO) || record.queue_backend > static_cast<std::uint8_t>(PackageQueueBackend::LIST)) {
+            corrupt_snapshot("nieznany typ kolejki");
+        }
+        if (record.servers == 0) {
+            corrupt_snapshot("robotnik bez stanowisk");
+        }
+        factory.add_worker(Worker(record.id, distribution_of(record.processing_distribution, record.processing_time, bins, header.bin_count), make_package_queue(static_cast<PackageQueueType>(record.queue_type), static_cast<PackageQueueBackend>(record.queue_backend), factory.get_package_resource()), record.capacity, record.servers));
+        Worker* worker = &*factory.find_worker_by_id(record.id);
+        receivers.push_back(worker);
+        senders.push_back(worker);
+    }
+    for (std::uint64_t i = 0; i < header.storehouse_count; ++i) {
+        factory.add_storehouse(Storehouse(storehouses[i].id, make_package_queue(PackageQueueType::LIFO, PackageQueueBackend::RING, factory.get_package_resource()), storehouses[i].capacity));
+        receivers.push_back(&*factory.find_storehouse_by_id(storehouses[i].id));
+    }
+
+    if (offsets[0] != 0 || offsets[senders.size()] != header.edge_count) {
+        corrupt_snapshot("niespójna tablica krawędzi");
+    }
+    for (std::size_t s = 0; s < senders.size(); ++s) {
+        if (offsets[s + 1] < offsets[s] || offsets[s + 1] > header.edge_count) {
+            corrupt_snapshot("niespójna tablica krawędzi");
+        }
+        for (std::uint64_t e = offsets[s]; e < offsets[s + 1]; ++e) {
+            if (targets[e] >= receivers.size()) {
+                corrupt_snapshot("nieznany odbiorca");
+            }
+            senders[s]->receiver_preferences_.add_receiver(receivers[targets[e]], weights[e]);
+        }
+    }
+
+    return factory;
+}
+
+
+Factory load_factory_snapshot(std::istream& input_stream, std::shared_ptr<FactoryMemory> memory) {
+    std::vector<char> data((std::istreambuf_iterator<char>(input_stream)), std::istreambuf_iterator<char>());
+    return load_factory_snapshot(data.data(), data.size(), std::move(memory));
+}
+
+
+Factory load_factory_snapshot_file(const std::string& path, std::shared_ptr<FactoryMemory> memory) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Nie można otworzyć pliku " + path);
+    }
+
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        ::close(fd);
+        corrupt_snapshot(path);
+    }
+
+    auto size = static_cast<std::size_t>(file_stat.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Nie można zmapować pliku " + path);
+    }
+
+    try {
+        Factory factory = load_factory_snapshot(data, size, std::move(memory));
+        ::munmap(data, size);
+        return factory;
+    } catch (...) {
+        ::munmap(data, size);
+        throw;
+    }
+}
+
+
+void convert_structure_to_snapshot(const std::string& structure_path, const std::string& snapshot_path) {
+    Factory factory = load_factory_structure_file(structure_path);
+    std::ofstream output_stream(snapshot_path, std::ios::binary);
+    save_factory_snapshot(factory, output_stream);
+    if (!output_stream) {
+        throw std::runtime_error("Błąd zapisu pliku " + snapshot_path);
+    }
+}
+
+
+void convert_snapshot_to_structure(const std::string& snapshot_path, const std::string& structure_path) {
+    Factory factory = load_factory_snapshot_file(snapshot_path);
+    std::ofstream output_stream(structure_path);
+    save_factory_structure(factory, output_stream);
+    if (!output_stream) {
+        throw std::runtime_error("Błąd zapisu pliku " + structure_path);
+    }
+}
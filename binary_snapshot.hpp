@@ -0,0 +1,83 @@
+#ifndef BINARY_SNAPSHOT_HPP
+#define BINARY_SNAPSHOT_HPP
+
+#include "factory.hpp"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Binary structure snapshot, in host byte order:
+//   SnapshotHeader
+//   RampRecord[ramp_count], WorkerRecord[worker_count], StorehouseRecord[storehouse_count]
+//   uint64_t edge_offsets[ramp_count + worker_count + 1]   (senders: ramps, then workers)
+//   double edge_weights[edge_count]
+//   uint32_t edge_targets[edge_count]                      (receivers: workers, then storehouses)
+//   EmpiricalBinRecord bins[bin_count]                     (bins of every empirical distribution)
+// Every section starts at an 8-byte boundary, so a mapped file is read in place.
+
+constexpr char SNAPSHOT_MAGIC[8] = {'N', 'E', 'T', 'S', 'I', 'M', 'B', '\0'};
+constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::uint64_t ramp_count;
+    std::uint64_t worker_count;
+    std::uint64_t storehouse_count;
+    std::uint64_t edge_count;
+    std::uint64_t bin_count;
+};
+
+// A drawn time; with type FIXED the plain time of the record is used instead.
+// The parameters are those of TimeDistribution::get_a and get_b.
+struct TimeDistributionRecord {
+    std::uint8_t type;
+    std::uint8_t padding[3];
+    std::uint32_t bin_begin;
+    std::uint32_t bin_count;
+    std::uint32_t padding2;
+    double a;
+    double b;
+};
+
+struct EmpiricalBinRecord {
+    std::int32_t value;
+    std::uint32_t padding;
+    double weight;
+};
+
+struct RampRecord {
+    std::int32_t id;
+    std::int32_t delivery_interval;
+    TimeDistributionRecord delivery_distribution;
+};
+
+struct WorkerRecord {
+    std::int32_t id;
+    std::int32_t processing_time;
+    std::uint8_t queue_type;
+    std::uint8_t queue_backend;
+    std::uint8_t padding[2];
+    // 0 for an unbounded queue
+    std::uint32_t capacity;
+    std::uint32_t servers;
+    std::uint32_t padding2;
+    TimeDistributionRecord processing_distribution;
+};
+
+struct StorehouseRecord {
+    std::int32_t id;
+    std::uint32_t capacity;
+};
+
+
+void save_factory_snapshot(const Factory& factory, std::ostream& output_stream);
+Factory load_factory_snapshot(const void* data, std::size_t size, std::shared_ptr<FactoryMemory> memory = nullptr);
+Factory load_factory_snapshot(std::istream& input_stream, std::shared_ptr<FactoryMemory> memory = nullptr);
+Factory load_factory_snapshot_file(const std::string& path, std::shared_ptr<FactoryMemory> memory = nullptr);
+
+void convert_structure_to_snapshot(const std::string& structure_path, const std::string& snapshot_path);
+void convert_snapshot_to_structure(const std::string& snapshot_path, const std::string& structure_path);
+
+#endif //BINARY_SNAPSHOT_HPP
@@ -0,0 +1,372 @@
+#include "checkpoint.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+[[noreturn]] void corrupt_checkpoint(const std::string& reason) {
+    throw std::runtime_error("Niepoprawny punkt kontrolny: " + reason);
+}
+
+void write_id(std::ostream& output_stream, ElementID id) {
+    auto value = static_cast<std::int32_t>(id);
+    output_stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void write_counter(std::ostream& output_stream, std::uint64_t counter) {
+    write_id(output_stream, static_cast<ElementID>(static_cast<std::int32_t>(counter & 0xFFFFFFFFu)));
+    write_id(output_stream, static_cast<ElementID>(static_cast<std::int32_t>(counter >> 32)));
+}
+
+void write_position(std::ostream& output_stream, const DurationSampler::Position& position) {
+    write_counter(output_stream, position.block_start);
+    write_id(output_stream, static_cast<ElementID>(position.index));
+}
+
+ElementID buffered_id(const std::optional<Package>& buffer) {
+    return buffer ? buffer->get_id() : PackageIDAllocator::NO_ID;
+}
+
+void write_stock(std::ostream& output_stream, const IPackageStockpile& stock) {
+    write_id(output_stream, static_cast<ElementID>(stock.size()));
+    for (const auto& package : stock) {
+        write_id(output_stream, package.get_id());
+    }
+}
+
+
+class CheckpointReader {
+public:
+    CheckpointReader(std::istream& input_stream, ElementID next_fresh) : input_stream_(input_stream), next_fresh_(next_fresh) {}
+
+    std::int32_t value() {
+        std::int32_t v;
+        if (!input_stream_.read(reinterpret_cast<char*>(&v), sizeof(v))) {
+            corrupt_checkpoint("nieoczekiwany koniec danych");
+        }
+        return v;
+    }
+
+    std::uint64_t counter() {
+        auto low = static_cast<std::uint32_t>(value());
+        auto high = static_cast<std::uint32_t>(value());
+        return (static_cast<std::uint64_t>(high) << 32) | low;
+    }
+
+    ElementID package_id(bool allow_empty) {
+        auto id = static_cast<ElementID>(value());
+        if (allow_empty && id == PackageIDAllocator::NO_ID) {
+            return id;
+        }
+        if (id <= PackageIDAllocator::NO_ID || id >= next_fresh_) {
+            corrupt_checkpoint("identyfikator półproduktu " + std::to_string(id) + " poza zakresem");
+        }
+        return id;
+    }
+
+    DurationSampler::Position position() {
+        std::uint64_t block_start = counter();
+        std::int32_t index = value();
+        if (index < 0 || static_cast<std::size_t>(index) > DurationSampler::BLOCK_SIZE) {
+            corrupt_checkpoint("niepoprawna pozycja strumienia losowych czasów");
+        }
+        return {block_start, static_cast<std::uint32_t>(index)};
+    }
+
+    // A count followed by that many IDs.
+    template<typename Visitor>
+    void for_each_package_id(Visitor&& visit) {
+        std::int32_t count = value();
+        if (count < 0) {
+            corrupt_checkpoint("ujemny rozmiar kolejki");
+        }
+        for (std::int32_t i = 0; i < count; ++i) {
+            visit(package_id(false));
+        }
+    }
+
+private:
+    std::istream& input_stream_;
+    ElementID next_fresh_;
+};
+
+template<typename Iterator>
+std::uint64_t count_nodes(Iterator begin, Iterator end) {
+    return static_cast<std::uint64_t>(std::distance(begin, end));
+}
+
+template<typename Iterator>
+Iterator find_node(Iterator found, Iterator end, const char* kind, ElementID id) {
+    if (found == end) {
+        corrupt_checkpoint(std::string("brak ") + kind + " o ID " + std::to_string(id));
+    }
+    return found;
+}
+
+
+CheckpointHeader read_header(const Factory& factory, std::istream& input_stream) {
+    CheckpointHeader header;
+    if (!input_stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        corrupt_checkpoint("za krótki nagłówek");
+    }
+    if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+        corrupt_checkpoint("zła sygnatura");
+    }
+    if (header.version != CHECKPOINT_VERSION || header.header_size != sizeof(CheckpointHeader)) {
+        corrupt_checkpoint("nieobsługiwana wersja " + std::to_string(header.version));
+    }
+    if (header.id_policy > static_cast<std::uint8_t>(IDReusePolicy::LOWEST_FREE) || header.next_fresh_id <= PackageIDAllocator::NO_ID) {
+        corrupt_checkpoint("niepoprawny stan puli identyfikatorów");
+    }
+    if (header.ramp_count != count_nodes(factory.ramp_cbegin(), factory.ramp_cend())
+        || header.worker_count != count_nodes(factory.worker_cbegin(), factory.worker_cend())
+        || header.storehouse_count != count_nodes(factory.storehouse_cbegin(), factory.storehouse_cend())) {
+        corrupt_checkpoint("struktura sieci nie odpowiada punktowi kontrolnemu");
+    }
+    return header;
+}
+
+
+std::optional<Package> buffer_of(ElementID id) {
+    return id == PackageIDAllocator::NO_ID ? std::optional<Package>() : std::optional<Package>(Package(id));
+}
+
+
+// Old packages release their IDs before the allocator is rewound.
+void clear_packages(Factory& factory) {
+    for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+        it->take_sending_buffer();
+    }
+    for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+        while (it->take_processing_buffer()) {
+        }
+        while (it->take_finished()) {
+        }
+        it->take_sending_buffer();
+        it->get_queue()->clear();
+    }
+    for (auto it = factory.storehouse_begin(); it != factory.storehouse_end(); ++it) {
+        it->get_stockpile()->clear();
+    }
+}
+
+
+// A node record of the stream, applied to its node as it is read.
+void restore_ramp(Factory& factory, CheckpointReader& reader) {
+    ElementID id = reader.value();
+    Ramp& ramp = *find_node(factory.find_ramp_by_id(id), factory.ramp_end(), "rampy", id);
+    ramp.restore_sending_buffer(buffer_of(reader.package_id(true)));
+    Time next_delivery = reader.value();
+    ramp.restore_durations(next_delivery, reader.position());
+    ramp.receiver_preferences_.set_stream_counter(reader.counter());
+}
+
+void restore_worker(Factory& factory, CheckpointReader& reader) {
+    ElementID id = reader.value();
+    Worker& worker = *find_node(factory.find_worker_by_id(id), factory.worker_end(), "robotnika", id);
+    Time start = reader.value();
+    worker.set_duration_position(reader.position());
+    worker.receiver_preferences_.set_stream_counter(reader.counter());
+    std::int32_t in_service = reader.value();
+    if (in_service < 0 || static_cast<std::size_t>(in_service) > worker.get_servers()) {
+        corrupt_checkpoint("niepoprawna liczba półproduktów w obróbce u robotnika " + std::to_string(id));
+    }
+    for (std::int32_t j = 0; j < in_service; ++j) {
+        ElementID package = reader.package_id(false);
+        Time package_start = reader.value();
+        worker.restore_processing_buffer(Package(package), package_start, reader.value());
+    }
+    if (in_service == 0) {
+        worker.restore_processing_buffer(std::nullopt, start);
+    }
+    std::int32_t sending = reader.value();
+    if (sending < 0 || static_cast<std::size_t>(sending) > worker.get_servers()) {
+        corrupt_checkpoint("niepoprawna liczba gotowych półproduktów u robotnika " + std::to_string(id));
+    }
+    for (std::int32_t j = 0; j < sending; ++j) {
+        if (j == 0) {
+            worker.restore_sending_buffer(Package(reader.package_id(false)));
+        } else {
+            worker.restore_finished(Package(reader.package_id(false)));
+        }
+    }
+    reader.for_each_package_id([&worker](ElementID package) { worker.get_queue()->push(Package(package)); });
+}
+
+void restore_storehouse(Factory& factory, CheckpointReader& reader) {
+    ElementID id = reader.value();
+    Storehouse& storehouse = *find_node(factory.find_storehouse_by_id(id), factory.storehouse_end(), "magazynu", id);
+    reader.for_each_package_id([&storehouse](ElementID package) { storehouse.get_stockpile()->push(Package(package)); });
+}
+
+}
+
+
+CheckpointHeader make_checkpoint_header(const Factory& factory, Time next_turn, IDReusePolicy id_policy, ElementID next_fresh_id, std::uint64_t free_count) {
+    CheckpointHeader header {};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.header_size = sizeof(CheckpointHeader);
+    header.next_turn = next_turn;
+    header.id_policy = static_cast<std::uint8_t>(id_policy);
+    header.next_fresh_id = next_fresh_id;
+    header.free_count = free_count;
+    header.ramp_count = count_nodes(factory.ramp_cbegin(), factory.ramp_cend());
+    header.worker_count = count_nodes(factory.worker_cbegin(), factory.worker_cend());
+    header.storehouse_count = count_nodes(factory.storehouse_cbegin(), factory.storehouse_cend());
+    return header;
+}
+
+
+void CheckpointWriter::write_header(const CheckpointHeader& header) {
+    output_stream_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+
+void CheckpointWriter::write_free_id(ElementID id) {
+    write_id(output_stream_, id);
+}
+
+
+void CheckpointWriter::write_node(const Ramp& ramp) {
+    write_id(output_stream_, ramp.get_id());
+    write_id(output_stream_, buffered_id(ramp.get_sending_buffer()));
+    write_id(output_stream_, ramp.get_drawn_next_delivery());
+    write_position(output_stream_, ramp.get_duration_position());
+    write_counter(output_stream_, ramp.receiver_preferences_.get_stream_counter());
+}
+
+
+void CheckpointWriter::write_node(const Worker& worker) {
+    write_id(output_stream_, worker.get_id());
+    write_id(output_stream_, worker.get_package_processing_start_time());
+    write_position(output_stream_, worker.get_duration_position());
+    write_counter(output_stream_, worker.receiver_preferences_.get_stream_counter());
+    std::int32_t in_service = 0;
+    worker.for_each_in_service([&in_service](const Package&, Time, Time) { ++in_service; });
+    write_id(output_stream_, static_cast<ElementID>(in_service));
+    worker.for_each_in_service([this](const Package& package, Time start, Time finish) {
+        write_id(output_stream_, package.get_id());
+        write_id(output_stream_, start);
+        write_id(output_stream_, finish);
+    });
+    write_id(output_stream_, static_cast<ElementID>((worker.get_sending_buffer() ? 1 : 0) + worker.get_finished().size()));
+    if (worker.get_sending_buffer()) {
+        write_id(output_stream_, worker.get_sending_buffer()->get_id());
+    }
+    for (const auto& package : worker.get_finished()) {
+        write_id(output_stream_, package.get_id());
+    }
+    write_stock(output_stream_, *worker.get_queue());
+}
+
+
+void CheckpointWriter::write_node(const Storehouse& storehouse) {
+    write_id(output_stream_, storehouse.get_id());
+    write_stock(output_stream_, *storehouse.get_stockpile());
+}
+
+
+void CheckpointWriter::finish() {
+    output_stream_.flush();
+    if (!output_stream_) {
+        throw std::runtime_error("Nie udało się zapisać punktu kontrolnego");
+    }
+}
+
+
+// The free IDs are counted for the header first, then written in a second pass.
+void save_checkpoint(const Factory& factory, Time next_turn, std::ostream& output_stream) {
+    const PackageIDAllocator& allocator = Package::get_id_allocator();
+    std::uint64_t free_count = 0;
+    allocator.for_each_free([&free_count](ElementID) { ++free_count; });
+
+    CheckpointWriter writer(output_stream);
+    writer.write_header(make_checkpoint_header(factory, next_turn, allocator.get_policy(), allocator.get_next_fresh(), free_count));
+    allocator.for_each_free([&writer](ElementID id) { writer.write_free_id(id); });
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        writer.write_node(*it);
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        writer.write_node(*it);
+    }
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        writer.write_node(*it);
+    }
+    writer.finish();
+}
+
+
+void save_checkpoint_file(const Factory& factory, Time next_turn, const std::string& path) {
+    std::ofstream output_stream(path, std::ios::binary | std::ios::trunc);
+    if (!output_stream) {
+        throw std::runtime_error("Nie można otworzyć pliku " + path);
+    }
+    save_checkpoint(factory, next_turn, output_stream);
+}
+
+
+CheckpointHeader CheckpointRestorer::restore_header(std::istream& input_stream) {
+    CheckpointHeader header = read_header(factory_, input_stream);
+    id_policy_ = static_cast<IDReusePolicy>(header.id_policy);
+    next_fresh_id_ = header.next_fresh_id;
+    clear_packages(factory_);
+    PackageIDAllocator& allocator = Package::get_id_allocator();
+    allocator.begin_restore(id_policy_, next_fresh_id_);
+    try {
+        CheckpointReader reader(input_stream, next_fresh_id_);
+        for (std::uint64_t i = 0; i < header.free_count; ++i) {
+            allocator.restore_free(reader.package_id(false));
+        }
+    } catch (...) {
+        abandon();
+        throw;
+    }
+    return header;
+}
+
+
+void CheckpointRestorer::restore_nodes(std::istream& input_stream, std::uint64_t ramp_count, std::uint64_t worker_count, std::uint64_t storehouse_count) {
+    try {
+        CheckpointReader reader(input_stream, next_fresh_id_);
+        for (std::uint64_t i = 0; i < ramp_count; ++i) {
+            restore_ramp(factory_, reader);
+        }
+        for (std::uint64_t i = 0; i < worker_count; ++i) {
+            restore_worker(factory_, reader);
+        }
+        for (std::uint64_t i = 0; i < storehouse_count; ++i) {
+            restore_storehouse(factory_, reader);
+        }
+    } catch (...) {
+        abandon();
+        throw;
+    }
+}
+
+
+// rather than half of the nodes restored
+void CheckpointRestorer::abandon() {
+    clear_packages(factory_);
+    Package::get_id_allocator().reset(id_policy_);
+}
+
+
+Time restore_checkpoint(Factory& factory, std::istream& input_stream) {
+    CheckpointRestorer restorer(factory);
+    CheckpointHeader header = restorer.restore_header(input_stream);
+    restorer.restore_nodes(input_stream, header.ramp_count, header.worker_count, header.storehouse_count);
+    return static_cast<Time>(header.next_turn);
+}
+
+
+Time restore_checkpoint_file(Factory& factory, const std::string& path) {
+    std::ifstream input_stream(path, std::ios::binary);
+    if (!input_stream) {
+        throw std::runtime_error("Nie można otworzyć pliku " + path);
+    }
+    return restore_checkpoint(factory, input_stream);
+}
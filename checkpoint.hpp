@@ -0,0 +1,95 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "factory.hpp"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Dynamic state of a running simulation, streamed in host byte order after the structure
+// (which is saved separately, as text or as a binary snapshot):
+//   CheckpointHeader
+//   int32_t free_ids[free_count]                  (in the order the allocator reuses them)
+//   per ramp:       int32_t id, sending_id, next_delivery, position[3], routing[2]
+//   per worker:     int32_t id, start_time, position[3], routing[2], in_service, {id, start, finish}[in_service],
+//                   sending_size, sending_ids[sending_size], queue_size, queue_ids[queue_size]
+//   per storehouse: int32_t id, stock_size, stock_ids[stock_size]
+// An empty ramp buffer is stored as PackageIDAllocator::NO_ID. Packages in service are stored in order
+// of completion, the worker's sending buffer first and then its finished packages, queues in iteration order.
+// position is where the node's stream of drawn times stands (DurationSampler::Position: the low and
+// high halves of block_start, then index); next_delivery is only used by ramps with a drawn interval.
+// routing is the low and high half of the counter of the sender's routing stream (see Factory::set_routing_seed).
+
+constexpr char CHECKPOINT_MAGIC[8] = {'N', 'E', 'T', 'S', 'I', 'M', 'C', '\0'};
+constexpr std::uint32_t CHECKPOINT_VERSION = 4;
+
+struct CheckpointHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::int64_t next_turn;
+    std::uint8_t id_policy;
+    std::uint8_t padding[3];
+    std::int32_t next_fresh_id;
+    std::uint64_t free_count;
+    std::uint64_t ramp_count;
+    std::uint64_t worker_count;
+    std::uint64_t storehouse_count;
+};
+
+
+// The stream format section by section, for a checkpoint written in several parts (see
+// simulate_sharded): the header with the free IDs in one, the node records in any number of
+// parts, each with the records of some ramps, then some workers, then some storehouses.
+CheckpointHeader make_checkpoint_header(const Factory& factory, Time next_turn, IDReusePolicy id_policy, ElementID next_fresh_id, std::uint64_t free_count);
+
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(std::ostream& output_stream) : output_stream_(output_stream) {}
+
+    // To be followed by header.free_count free IDs.
+    void write_header(const CheckpointHeader& header);
+    void write_free_id(ElementID id);
+    void write_node(const Ramp& ramp);
+    void write_node(const Worker& worker);
+    void write_node(const Storehouse& storehouse);
+    // Throws if anything failed to be written.
+    void finish();
+
+private:
+    std::ostream& output_stream_;
+};
+
+// Applies the parts as they are read. restore_header checks the header against the factory before
+// touching it, then clears the factory's packages and rewinds the global package ID allocator.
+// A corrupt record leaves the factory without packages.
+class CheckpointRestorer {
+public:
+    explicit CheckpointRestorer(Factory& factory) : factory_(factory) {}
+
+    CheckpointHeader restore_header(std::istream& input_stream);
+    void restore_nodes(std::istream& input_stream, std::uint64_t ramp_count, std::uint64_t worker_count, std::uint64_t storehouse_count);
+
+private:
+    Factory& factory_;
+    IDReusePolicy id_policy_ = IDReusePolicy::ANY_FREE;
+    ElementID next_fresh_id_ = PackageIDAllocator::NO_ID;
+
+    void abandon();
+};
+
+
+// Streamed from the factory node by node.
+// next_turn is the first turn not yet simulated; pass it back to simulate() as first_turn.
+// The probability generator is not part of the checkpoint - reseed it on restore if runs must match.
+void save_checkpoint(const Factory& factory, Time next_turn, std::ostream& output_stream);
+void save_checkpoint_file(const Factory& factory, Time next_turn, const std::string& path);
+
+// The factory must have the structure the checkpoint was taken from. Its packages are replaced
+// and the global package ID allocator is reset, so no packages may live outside the factory.
+// The header is checked before the factory is touched; the node records are then applied as they
+// are read, and a corrupt one leaves the factory without packages. Returns the turn to resume from.
+Time restore_checkpoint(Factory& factory, std::istream& input_stream);
+Time restore_checkpoint_file(Factory& factory, const std::string& path);
+
+#endif //CHECKPOINT_HPP
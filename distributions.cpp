@@ -0,0 +1,259 @@
+#include "distributions.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+std::uint64_t splitmix64(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+TimeOffset round_to_turns(double value) {
+    return static_cast<TimeOffset>(std::max(value, 1.0) + 0.5);
+}
+
+void append_number(std::string& text, double value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    text.append(buffer, result.ptr);
+}
+
+}
+
+
+CounterRng::CounterRng(std::uint64_t seed, std::uint64_t stream) : key_(splitmix64(seed ^ splitmix64(stream))) {}
+
+
+double CounterRng::operator()() {
+    std::uint64_t bits = splitmix64(key_ + counter_++ * 0x9E3779B97F4A7C15ull);
+    return static_cast<double>(bits >> 11) * 0x1.0p-53;
+}
+
+
+void CounterRng::fill(double* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint64_t bits = splitmix64(key_ + (counter_ + i) * 0x9E3779B97F4A7C15ull);
+        out[i] = static_cast<double>(bits >> 11) * 0x1.0p-53;
+    }
+    counter_ += n;
+}
+
+
+TimeDistribution::TimeDistribution(TimeOffset value) : value_(value) {
+    if (value < 1) {
+        throw std::invalid_argument("Czas musi wynosić co najmniej jedną turę");
+    }
+}
+
+
+TimeDistribution TimeDistribution::exponential(double mean) {
+    if (!(mean > 0.0)) {
+        throw std::invalid_argument("Średnia rozkładu wykładniczego musi być dodatnia");
+    }
+    TimeDistribution distribution(round_to_turns(mean));
+    distribution.type_ = TimeDistributionType::EXPONENTIAL;
+    distribution.a_ = mean;
+    return distribution;
+}
+
+
+TimeDistribution TimeDistribution::uniform(TimeOffset low, TimeOffset high) {
+    if (low < 1 || high < low) {
+        throw std::invalid_argument("Rozkład jednostajny wymaga 1 <= min <= max");
+    }
+    TimeDistribution distribution(round_to_turns((low + high) / 2.0));
+    distribution.type_ = TimeDistributionType::UNIFORM;
+    distribution.a_ = low;
+    distribution.b_ = high;
+    return distribution;
+}
+
+
+TimeDistribution TimeDistribution::normal(double mean, double stddev) {
+    // With the mean at one turn or more at least half of the samples are accepted.
+    if (!(mean >= 1.0) || !(stddev >= 0.0)) {
+        throw std::invalid_argument("Rozkład normalny wymaga średniej >= 1 i nieujemnego odchylenia");
+    }
+    TimeDistribution distribution(round_to_turns(mean));
+    distribution.type_ = TimeDistributionType::NORMAL;
+    distribution.a_ = mean;
+    distribution.b_ = stddev;
+    return distribution;
+}
+
+
+TimeDistribution TimeDistribution::empirical(std::vector<EmpiricalBin> bins) {
+    double total = 0.0;
+    for (const auto& bin : bins) {
+        if (bin.value < 1 || !(bin.weight > 0.0)) {
+            throw std::invalid_argument("Przedziały rozkładu empirycznego wymagają czasu >= 1 i dodatniej wagi");
+        }
+        total += bin.weight;
+    }
+    if (bins.empty()) {
+        throw std::invalid_argument("Rozkład empiryczny nie ma przedziałów");
+    }
+
+    auto table = std::make_shared<EmpiricalTable>();
+    double cumulative = 0.0;
+    double mean = 0.0;
+    for (std::size_t i = 0; i < bins.size(); ++i) {
+        cumulative += bins[i].weight / total;
+        mean += bins[i].value * bins[i].weight / total;
+        if (i + 1 < bins.size()) {
+            table->cumulative.push_back(cumulative);
+        }
+    }
+    table->bins = std::move(bins);
+
+    TimeDistribution distribution(round_to_turns(mean));
+    distribution.type_ = TimeDistributionType::EMPIRICAL;
+    distribution.table_ = std::move(table);
+    return distribution;
+}
+
+
+double TimeDistribution::get_mean() const {
+    switch (type_) {
+        case TimeDistributionType::FIXED:
+            return value_;
+        case TimeDistributionType::UNIFORM:
+            return (a_ + b_) / 2.0;
+        case TimeDistributionType::EMPIRICAL: {
+            double total = 0.0;
+            double sum = 0.0;
+            for (const auto& bin : table_->bins) {
+                total += bin.weight;
+                sum += bin.value * bin.weight;
+            }
+            return sum / total;
+        }
+        default:
+            return a_;
+    }
+}
+
+
+const std::vector<EmpiricalBin>& TimeDistribution::get_bins() const {
+    static const std::vector<EmpiricalBin> no_bins;
+    return table_ ? table_->bins : no_bins;
+}
+
+
+std::size_t TimeDistribution::transform(const double* uniforms, TimeOffset* out, std::size_t n) const {
+    switch (type_) {
+        case TimeDistributionType::FIXED:
+            std::fill(out, out + n, value_);
+            return n;
+
+        case TimeDistributionType::EXPONENTIAL:
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = round_to_turns(-a_ * std::log1p(-uniforms[i]));
+            }
+            return n;
+
+        case TimeDistributionType::UNIFORM: {
+            auto low = static_cast<TimeOffset>(a_);
+            double span = b_ - a_ + 1.0;
+            for (std::size_t i = 0; i < n; ++i) {
+                out[i] = low + static_cast<TimeOffset>(uniforms[i] * span);
+            }
+            return n;
+        }
+
+        case TimeDistributionType::NORMAL: {
+            // Box-Muller over pairs of uniforms, then a branch-free compaction of the accepted samples.
+            constexpr double TWO_PI = 6.283185307179586;
+            std::size_t produced = 0;
+            for (std::size_t i = 0; i + 1 < n; i += 2) {
+                double radius = b_ * std::sqrt(-2.0 * std::log1p(-uniforms[i]));
+                double angle = TWO_PI * uniforms[i + 1];
+                double first = a_ + radius * std::cos(angle);
+                double second = a_ + radius * std::sin(angle);
+                out[produced] = static_cast<TimeOffset>(first + 0.5);
+                produced += first >= 0.5;
+                out[produced] = static_cast<TimeOffset>(second + 0.5);
+                produced += second >= 0.5;
+            }
+            return produced;
+        }
+
+        case TimeDistributionType::EMPIRICAL: {
+            // Counting the thresholds below u instead of a binary search keeps the loop free of branches.
+            const std::vector<double>& cumulative = table_->cumulative;
+            const std::vector<EmpiricalBin>& bins = table_->bins;
+            for (std::size_t i = 0; i < n; ++i) {
+                std::size_t bin = 0;
+                for (double threshold : cumulative) {
+                    bin += uniforms[i] >= threshold;
+                }
+                out[i] = bins[bin].value;
+            }
+            return n;
+        }
+    }
+    return 0;
+}
+
+
+std::string TimeDistribution::to_string() const {
+    std::string text;
+    switch (type_) {
+        case TimeDistributionType::FIXED:
+            return std::to_string(value_);
+        case TimeDistributionType::EXPONENTIAL:
+            text = "exp(";
+            append_number(text, a_);
+            break;
+        case TimeDistributionType::UNIFORM:
+            text = "uniform(";
+            append_number(text, a_);
+            text += ',';
+            append_number(text, b_);
+            break;
+        case TimeDistributionType::NORMAL:
+            text = "normal(";
+            append_number(text, a_);
+            text += ',';
+            append_number(text, b_);
+            break;
+        case TimeDistributionType::EMPIRICAL:
+            text = "empirical(";
+            for (std::size_t i = 0; i < table_->bins.size(); ++i) {
+                if (i) {
+                    text += ',';
+                }
+                text += std::to_string(table_->bins[i].value);
+                text += ':';
+                append_number(text, table_->bins[i].weight);
+            }
+            break;
+    }
+    return text + ")";
+}
+
+
+void DurationSampler::refill() {
+    std::array<double, BLOCK_SIZE> uniforms;
+    do {
+        block_start_ = rng_.get_counter();
+        rng_.fill(uniforms.data(), BLOCK_SIZE);
+        size_ = distribution_.transform(uniforms.data(), block_.data(), BLOCK_SIZE);
+    } while (size_ == 0);
+    index_ = 0;
+}
+
+
+void DurationSampler::set_position(const Position& position) {
+    if (distribution_.is_fixed()) {
+        return;
+    }
+    rng_.set_counter(position.block_start);
+    refill();
+    index_ = std::min<std::size_t>(position.index, size_);
+}
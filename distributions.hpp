@@ -0,0 +1,130 @@
+#ifndef DISTRIBUTIONS_HPP
+#define DISTRIBUTIONS_HPP
+
+#include "types.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Counter-based generator (SplitMix64 over a keyed counter): draw n of stream s is a pure
+// function of (seed, s, n), so replicas get independent streams however they are scheduled.
+class CounterRng {
+public:
+    CounterRng(std::uint64_t seed, std::uint64_t stream);
+
+    double operator()();
+    // The next n draws, exactly as n calls would return them; the loop has no carried state.
+    void fill(double* out, std::size_t n);
+
+    std::uint64_t get_counter() const { return counter_; }
+    void set_counter(std::uint64_t counter) { counter_ = counter; }
+
+private:
+    std::uint64_t key_;
+    std::uint64_t counter_ = 0;
+};
+
+
+enum class TimeDistributionType : std::uint8_t {
+    FIXED, EXPONENTIAL, UNIFORM, NORMAL, EMPIRICAL
+};
+
+struct EmpiricalBin {
+    TimeOffset value;
+    double weight;
+};
+
+
+// Number of turns a worker processes a package or a ramp waits between deliveries. Continuous
+// samples are rounded to the nearest turn; a normal distribution is truncated below one turn by
+// rejection, the others are clamped to at least one turn. Copies share the empirical table.
+// Every constructor rejects times below one turn with std::invalid_argument.
+class TimeDistribution {
+public:
+    TimeDistribution(TimeOffset value = 1);
+
+    static TimeDistribution exponential(double mean);
+    // low .. high inclusive
+    static TimeDistribution uniform(TimeOffset low, TimeOffset high);
+    static TimeDistribution normal(double mean, double stddev);
+    static TimeDistribution empirical(std::vector<EmpiricalBin> bins);
+
+    TimeDistributionType get_type() const { return type_; }
+    bool is_fixed() const { return type_ == TimeDistributionType::FIXED; }
+    // The fixed number of turns, or the mean rounded to a turn.
+    TimeOffset get_value() const { return value_; }
+    double get_mean() const;
+    // mean (EXPONENTIAL), low and high (UNIFORM), mean and standard deviation (NORMAL)
+    double get_a() const { return a_; }
+    double get_b() const { return b_; }
+    const std::vector<EmpiricalBin>& get_bins() const;
+
+    // Turns uniforms in [0, 1) into durations and returns how many were produced (fewer than n
+    // only for NORMAL, which uses two uniforms per pair of samples and drops rejected ones).
+    std::size_t transform(const double* uniforms, TimeOffset* out, std::size_t n) const;
+
+    // In the syntax of the structure format: "4", "exp(4)", "uniform(2,6)", "normal(5,1.5)", "empirical(1:0.2,3:0.8)".
+    std::string to_string() const;
+
+private:
+    struct EmpiricalTable {
+        std::vector<EmpiricalBin> bins;
+        // cumulative probabilities of all bins but the last
+        std::vector<double> cumulative;
+    };
+
+    TimeDistributionType type_ = TimeDistributionType::FIXED;
+    TimeOffset value_;
+    double a_ = 0.0;
+    double b_ = 0.0;
+    std::shared_ptr<const EmpiricalTable> table_;
+};
+
+
+// Per-node stream of durations. Draws are generated a block at a time from the node's own
+// CounterRng stream, so a node's durations depend only on the seed and the node, never on the
+// thread that runs it. Fixed durations skip the generator entirely.
+class DurationSampler {
+public:
+    static constexpr std::size_t BLOCK_SIZE = 64;
+
+    struct Position {
+        // counter of the stream at the start of the current block
+        std::uint64_t block_start;
+        std::uint32_t index;
+    };
+
+    DurationSampler(TimeDistribution distribution, std::uint64_t stream) : distribution_(std::move(distribution)), stream_(stream), rng_(0, stream) {}
+
+    void seed(std::uint64_t seed) { rng_ = CounterRng(seed, stream_); block_start_ = 0; index_ = 0; size_ = 0; }
+
+    TimeOffset next() {
+        if (distribution_.is_fixed()) {
+            return distribution_.get_value();
+        }
+        if (index_ == size_) {
+            refill();
+        }
+        return block_[index_++];
+    }
+
+    const TimeDistribution& get_distribution() const { return distribution_; }
+    Position get_position() const { return {block_start_, static_cast<std::uint32_t>(index_)}; }
+    void set_position(const Position& position);
+
+private:
+    void refill();
+
+    TimeDistribution distribution_;
+    std::uint64_t stream_;
+    CounterRng rng_;
+    std::uint64_t block_start_ = 0;
+    std::size_t index_ = 0;
+    std::size_t size_ = 0;
+    std::array<TimeOffset, BLOCK_SIZE> block_ {};
+};
+
+#endif //DISTRIBUTIONS_HPP
@@ -0,0 +1,256 @@
+#include "ensemble.hpp"
+#include "flat_factory.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+constexpr Time EMPTY_SLOT = std::numeric_limits<Time>::min();
+constexpr Time UNKNOWN_BIRTH = EMPTY_SLOT + 1;
+
+// Packages at the moment the ensemble starts; every replica begins from a copy.
+struct InitialState {
+    std::vector<Time> start_time;
+    std::vector<Time> finish_time;
+    std::vector<Time> processing;
+    std::vector<std::vector<Time>> queues;
+    std::vector<Time> next_delivery;
+    std::vector<Time> sending;
+    std::vector<std::size_t> stock;
+
+    InitialState(const Factory& factory) {
+        auto birth_of = [](bool occupied) { return occupied ? UNKNOWN_BIRTH : EMPTY_SLOT; };
+        for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+            start_time.push_back(it->get_package_processing_start_time());
+            finish_time.push_back(it->get_processing_buffer() ? it->get_next_completion() : 0);
+            processing.push_back(birth_of(it->get_processing_buffer() != nullptr));
+            queues.emplace_back(it->get_queue()->size(), UNKNOWN_BIRTH);
+            sending.push_back(birth_of(it->get_sending_buffer().has_value()));
+        }
+        for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+            next_delivery.push_back(it->get_drawn_next_delivery());
+            sending.push_back(birth_of(it->get_sending_buffer().has_value()));
+        }
+        for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+            stock.push_back(it->get_stockpile()->size());
+        }
+    }
+};
+
+
+struct ReplicaResult {
+    std::vector<std::uint64_t> received;
+    std::vector<double> mean_latency;
+    std::vector<std::vector<std::uint64_t>> latency_histogram;
+    std::vector<double> mean_queue_length;
+};
+
+
+// Durations of replica r are drawn on the nodes' own streams (as in the object engine) with this seed.
+std::uint64_t replica_seed(std::uint64_t seed, std::size_t replica) {
+    return seed ^ ((static_cast<std::uint64_t>(replica) + 1) * 0x9E3779B97F4A7C15ull);
+}
+
+
+// One replica: a flat turn state whose packages are the turns they left a ramp.
+class Replica {
+public:
+    Replica(const FlatStructure& structure, const InitialState& initial, CounterRng rng, std::uint64_t duration_seed)
+        : structure_(structure), rng_(rng), state_(structure, EMPTY_SLOT) {
+        for (auto& sampler : state_.processing_time) {
+            sampler.seed(duration_seed);
+        }
+        for (auto& sampler : state_.delivery_interval) {
+            sampler.seed(duration_seed);
+        }
+        state_.start_time = initial.start_time;
+        state_.finish_time = initial.finish_time;
+        state_.processing = initial.processing;
+        state_.next_delivery = initial.next_delivery;
+        state_.sending = initial.sending;
+        state_.stock = initial.stock;
+        for (std::size_t w = 0; w < structure.worker_count; ++w) {
+            for (Time birth : initial.queues[w]) {
+                state_.push_to_queue(w, birth);
+            }
+        }
+        result_.received.assign(structure.storehouse_count, 0);
+        result_.latency_histogram.resize(structure.storehouse_count);
+        result_.mean_queue_length.assign(structure.worker_count, 0.0);
+        latency_sum_.assign(structure.storehouse_count, 0.0);
+        latency_count_.assign(structure.storehouse_count, 0);
+    }
+
+    ReplicaResult run(TimeOffset d, Time first_turn) {
+        for (Time t = first_turn; t < first_turn + d; ++t) {
+            state_.do_deliveries(t, [](Time turn) { return turn; });
+            state_.do_package_passing([this](std::size_t) { return rng_(); },
+                                      [this, t](std::size_t storehouse, Time birth) { store(storehouse, birth, t); });
+            state_.do_work(t);
+            for (std::size_t w = 0; w < structure_.worker_count; ++w) {
+                result_.mean_queue_length[w] += static_cast<double>(state_.queue_size[w]);
+            }
+        }
+
+        for (double& queue_length : result_.mean_queue_length) {
+            queue_length /= d > 0 ? d : 1;
+        }
+        result_.mean_latency.resize(structure_.storehouse_count);
+        for (std::size_t s = 0; s < structure_.storehouse_count; ++s) {
+            result_.mean_latency[s] = latency_count_[s] ? latency_sum_[s] / static_cast<double>(latency_count_[s]) : std::nan("");
+        }
+        return std::move(result_);
+    }
+
+private:
+    void store(std::size_t storehouse, Time birth, Time t) {
+        ++result_.received[storehouse];
+        if (birth == UNKNOWN_BIRTH) {
+            return;
+        }
+        auto latency = static_cast<std::size_t>(t - birth);
+        auto& histogram = result_.latency_histogram[storehouse];
+        if (latency >= histogram.size()) {
+            histogram.resize(latency + 1, 0);
+        }
+        ++histogram[latency];
+        latency_sum_[storehouse] += static_cast<double>(latency);
+        ++latency_count_[storehouse];
+    }
+
+    const FlatStructure& structure_;
+    CounterRng rng_;
+    FlatTurnState<Time> state_;
+
+    ReplicaResult result_;
+    std::vector<double> latency_sum_;
+    std::vector<std::uint64_t> latency_count_;
+};
+
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return std::nan("");
+    }
+    double position = fraction * static_cast<double>(sorted.size() - 1);
+    auto below = static_cast<std::size_t>(position);
+    std::size_t above = std::min(below + 1, sorted.size() - 1);
+    return sorted[below] + (position - static_cast<double>(below)) * (sorted[above] - sorted[below]);
+}
+
+
+// Replicas without a value (NaN, e.g. no package reached a storehouse) are left out.
+SampleSummary summarize(std::vector<double> samples) {
+    samples.erase(std::remove_if(samples.begin(), samples.end(), [](double x) { return std::isnan(x); }), samples.end());
+    SampleSummary summary;
+    if (samples.empty()) {
+        summary.mean = summary.stddev = summary.ci95_low = summary.ci95_high = std::nan("");
+        summary.p5 = summary.p50 = summary.p95 = std::nan("");
+        return summary;
+    }
+
+    double sum = 0.0;
+    for (double x : samples) {
+        sum += x;
+    }
+    auto n = static_cast<double>(samples.size());
+    summary.mean = sum / n;
+
+    double squares = 0.0;
+    for (double x : samples) {
+        squares += (x - summary.mean) * (x - summary.mean);
+    }
+    summary.stddev = samples.size() > 1 ? std::sqrt(squares / (n - 1.0)) : 0.0;
+    double half_width = 1.96 * summary.stddev / std::sqrt(n);
+    summary.ci95_low = summary.mean - half_width;
+    summary.ci95_high = summary.mean + half_width;
+
+    std::sort(samples.begin(), samples.end());
+    summary.p5 = percentile(samples, 0.05);
+    summary.p50 = percentile(samples, 0.50);
+    summary.p95 = percentile(samples, 0.95);
+    return summary;
+}
+
+
+double histogram_percentile(const std::vector<std::uint64_t>& histogram, std::uint64_t total, double fraction) {
+    auto rank = static_cast<std::uint64_t>(std::ceil(fraction * static_cast<double>(total)));
+    std::uint64_t seen = 0;
+    for (std::size_t latency = 0; latency < histogram.size(); ++latency) {
+        seen += histogram[latency];
+        if (seen >= std::max<std::uint64_t>(rank, 1)) {
+            return static_cast<double>(latency);
+        }
+    }
+    return std::nan("");
+}
+
+}
+
+
+EnsembleReport run_ensemble(const Factory& factory, TimeOffset d, std::size_t replicas, std::uint64_t seed,
+                            std::shared_ptr<ThreadPool> pool, Time first_turn) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Sieć jest niespójna");
+    }
+    if (!pool) {
+        pool = std::make_shared<ThreadPool>();
+    }
+
+    const FlatStructure structure(factory);
+    const InitialState initial(factory);
+    std::vector<ReplicaResult> results(replicas);
+    pool->parallel_for(replicas, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t r = begin; r < end; ++r) {
+            Replica replica(structure, initial, CounterRng(seed, r), replica_seed(seed, r));
+            results[r] = replica.run(d, first_turn);
+        }
+    }, 1);
+
+    EnsembleReport report;
+    report.replicas = replicas;
+    report.turns = d;
+
+    std::vector<double> samples(replicas);
+    for (std::size_t s = 0; s < structure.storehouse_count; ++s) {
+        StorehouseEnsembleStats stats;
+        stats.id = structure.storehouse_ids[s];
+
+        for (std::size_t r = 0; r < replicas; ++r) {
+            samples[r] = static_cast<double>(results[r].received[s]);
+        }
+        stats.throughput = summarize(samples);
+        for (std::size_t r = 0; r < replicas; ++r) {
+            samples[r] = results[r].mean_latency[s];
+        }
+        stats.mean_latency = summarize(samples);
+
+        std::vector<std::uint64_t> pooled;
+        std::uint64_t total = 0;
+        for (const auto& result : results) {
+            const auto& histogram = result.latency_histogram[s];
+            if (histogram.size() > pooled.size()) {
+                pooled.resize(histogram.size(), 0);
+            }
+            for (std::size_t latency = 0; latency < histogram.size(); ++latency) {
+                pooled[latency] += histogram[latency];
+                total += histogram[latency];
+            }
+        }
+        stats.latency_p50 = histogram_percentile(pooled, total, 0.50);
+        stats.latency_p90 = histogram_percentile(pooled, total, 0.90);
+        stats.latency_p99 = histogram_percentile(pooled, total, 0.99);
+        stats.latency_max = pooled.empty() ? 0 : static_cast<Time>(pooled.size() - 1);
+        report.storehouses.push_back(stats);
+    }
+
+    for (std::size_t w = 0; w < structure.worker_count; ++w) {
+        for (std::size_t r = 0; r < replicas; ++r) {
+            samples[r] = results[r].mean_queue_length[w];
+        }
+        report.workers.push_back({structure.worker_ids[w], summarize(samples)});
+    }
+    return report;
+}
@@ -0,0 +1,58 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include "distributions.hpp"
+#include "factory.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Statistics of one value over all replicas; the confidence interval of the mean uses the normal approximation.
+struct SampleSummary {
+    double mean = 0.0;
+    double stddev = 0.0;
+    double ci95_low = 0.0;
+    double ci95_high = 0.0;
+    double p5 = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+};
+
+struct StorehouseEnsembleStats {
+    ElementID id;
+    SampleSummary throughput;
+    // per-replica mean number of turns from leaving a ramp to reaching the storehouse
+    SampleSummary mean_latency;
+    // latency percentiles pooled over the packages of all replicas
+    double latency_p50 = 0.0;
+    double latency_p90 = 0.0;
+    double latency_p99 = 0.0;
+    Time latency_max = 0;
+};
+
+struct WorkerEnsembleStats {
+    ElementID id;
+    SampleSummary mean_queue_length;
+};
+
+struct EnsembleReport {
+    std::size_t replicas = 0;
+    TimeOffset turns = 0;
+    std::vector<StorehouseEnsembleStats> storehouses;
+    std::vector<WorkerEnsembleStats> workers;
+};
+
+
+// Runs `replicas` independent copies of the factory for d turns, in parallel, starting from its
+// current packages (whose latency is unknown, so they only count towards throughput). Replicas share
+// one FlatStructure and keep only their mutable state; each draws receivers from its own CounterRng
+// stream instead of the senders' probability generators, and drawn durations from per-node streams
+// seeded for the replica. The factory itself is not modified.
+// As in simulate(), turns first_turn .. first_turn + d - 1 are run.
+EnsembleReport run_ensemble(const Factory& factory, TimeOffset d, std::size_t replicas, std::uint64_t seed,
+                            std::shared_ptr<ThreadPool> pool = nullptr, Time first_turn = 1);
+
+#endif //ENSEMBLE_HPP
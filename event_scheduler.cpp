@@ -0,0 +1,113 @@
+#include "event_scheduler.hpp"
+#include <limits>
+
+EventScheduler::EventScheduler(Factory& factory, Time start) : metrics_(factory.get_metrics().get()) {
+    for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+        worker_index_[&*it] = static_cast<std::uint32_t>(workers_.size());
+        workers_.push_back(&*it);
+    }
+    for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+        ramps_.push_back(&*it);
+    }
+
+    for (std::uint32_t i = 0; i < ramps_.size(); ++i) {
+        schedule(ramps_[i]->get_next_delivery(start), EventPhase::DELIVERY, i);
+        if (ramps_[i]->get_sending_buffer()) {
+            schedule(start, EventPhase::PASSING, static_cast<std::uint32_t>(workers_.size()) + i);
+        }
+    }
+
+    for (std::uint32_t i = 0; i < workers_.size(); ++i) {
+        if (workers_[i]->get_sending_buffer()) {
+            schedule(start, EventPhase::PASSING, i);
+        }
+        schedule_worker(i, start);
+    }
+}
+
+
+Time EventScheduler::next_turn() const {
+    return events_.empty() ? std::numeric_limits<Time>::max() : events_.top().t;
+}
+
+
+void EventScheduler::run_turn() {
+    if (events_.empty()) {
+        return;
+    }
+
+    Time t = events_.top().t;
+    if (metrics_) {
+        metrics_->begin_turn(t);
+    }
+    Package::get_payload_arena().begin_turn(t);
+    while (!events_.empty() && events_.top().t == t) {
+        SimulationEvent event = events_.top();
+        events_.pop();
+        while (!events_.empty() && events_.top() == event) {
+            events_.pop();
+        }
+
+        switch (event.phase) {
+            case EventPhase::DELIVERY:
+                deliver(event.order, t);
+                break;
+            case EventPhase::PASSING:
+                pass(event.order, t);
+                break;
+            case EventPhase::WORK:
+                work(event.order, t);
+                break;
+        }
+    }
+}
+
+
+void EventScheduler::schedule_worker(std::uint32_t index, Time t) {
+    const Worker& worker = *workers_[index];
+    if (worker.has_free_server() && !worker.get_queue()->empty()) {
+        schedule(t, EventPhase::WORK, index);
+    } else if (worker.get_processing_buffer()) {
+        Time finish = worker.get_next_completion();
+        schedule(finish > t ? finish : t, EventPhase::WORK, index);
+    }
+}
+
+
+void EventScheduler::deliver(std::uint32_t ramp_index, Time t) {
+    Ramp& ramp = *ramps_[ramp_index];
+    ramp.deliver_goods(t);
+    schedule(t, EventPhase::PASSING, static_cast<std::uint32_t>(workers_.size()) + ramp_index);
+    schedule(ramp.get_next_delivery(t + 1), EventPhase::DELIVERY, ramp_index);
+}
+
+
+void EventScheduler::pass(std::uint32_t sender_order, Time t) {
+    PackageSender* sender = sender_order < workers_.size()
+            ? static_cast<PackageSender*>(workers_[sender_order])
+            : static_cast<PackageSender*>(ramps_[sender_order - workers_.size()]);
+
+    while (IPackageReceiver* receiver = sender->send_package()) {
+        auto worker = worker_index_.find(receiver);
+        if (worker != worker_index_.end()) {
+            schedule(t, EventPhase::WORK, worker->second);
+        }
+        if (sender_order >= workers_.size() || !workers_[sender_order]->load_next_finished()) {
+            break;
+        }
+    }
+    if (sender->get_sending_buffer()) {
+        schedule(t + 1, EventPhase::PASSING, sender_order);
+    }
+}
+
+
+void EventScheduler::work(std::uint32_t worker_index, Time t) {
+    Worker& worker = *workers_[worker_index];
+    worker.do_work(t);
+
+    if (worker.get_sending_buffer()) {
+        schedule(t + 1, EventPhase::PASSING, worker_index);
+    }
+    schedule_worker(worker_index, t + 1);
+}
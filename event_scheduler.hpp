@@ -0,0 +1,58 @@
+#ifndef EVENT_SCHEDULER_HPP
+#define EVENT_SCHEDULER_HPP
+
+#include "factory.hpp"
+#include "types.hpp"
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+enum class EventPhase : std::uint8_t {
+    DELIVERY, PASSING, WORK
+};
+
+
+struct SimulationEvent {
+    Time t;
+    EventPhase phase;
+    std::uint32_t order;
+
+    bool operator>(const SimulationEvent& other) const {
+        if (t != other.t) return t > other.t;
+        if (phase != other.phase) return phase > other.phase;
+        return order > other.order;
+    }
+    bool operator==(const SimulationEvent& other) const { return t == other.t && phase == other.phase && order == other.order; }
+};
+
+
+// Drives the factory from a queue of "ramp delivers", "sender passes" and "worker works" events.
+// Events of one turn are ordered exactly like the tick engine visits the nodes, so both
+// engines consume the ProbabilityGenerator in the same order and produce identical states.
+// The factory structure must not change while the scheduler is alive.
+class EventScheduler {
+public:
+    EventScheduler(Factory& factory, Time start = 1);
+
+    Time next_turn() const;
+    void run_turn();
+
+private:
+    void schedule(Time t, EventPhase phase, std::uint32_t order) { events_.push({t, phase, order}); }
+    void schedule_worker(std::uint32_t index, Time t);
+    void schedule_passing(IPackageReceiver* receiver, Time t);
+
+    void deliver(std::uint32_t ramp_index, Time t);
+    void pass(std::uint32_t sender_order, Time t);
+    void work(std::uint32_t worker_index, Time t);
+
+    FactoryMetrics* metrics_;
+    std::vector<Ramp*> ramps_;
+    std::vector<Worker*> workers_;
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> worker_index_;
+    std::priority_queue<SimulationEvent, std::vector<SimulationEvent>, std::greater<SimulationEvent>> events_;
+};
+
+#endif //EVENT_SCHEDULER_HPP
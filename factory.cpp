@@ -1,376 +1,472 @@
-#include "nodes.hxx"
-#include "factory.hxx"
-
-bool has_reachable_storehouse(const PackageSender* sender, std::map<const PackageSender*, NodeColor>& colors_of_nodes) {
-    if (colors_of_nodes[sender] == NodeColor::VERIFIED) { return true; }
-    colors_of_nodes[sender] = NodeColor::VISITED;
-
-    const auto& pref = sender->receiver_preferences_.get_preferences();
-    if (pref.empty()) {
-        throw std::logic_error("Brak zdefiniowanych odbiorców");
+#include "nodes.hpp"
+#include "factory.hpp"
+
+ConsistencyReport Factory::check_consistency(const std::unordered_set<const PackageSender*>& excluded) const {
+    // Senders are indexed workers first, then ramps; only workers can be link targets.
+    // Excluded senders (about to be removed, with all links already dropped) are skipped.
+    std::size_t sender_count = workers_.size() + ramps_.size();
+
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> worker_index;
+    worker_index.reserve(workers_.size());
+    std::vector<const PackageSender*> senders;
+    std::vector<NodeRef> refs;
+    senders.reserve(sender_count);
+    refs.reserve(sender_count);
+    for (const auto& worker : workers_) {
+        if (excluded.count(&worker)) {
+            continue;
+        }
+        worker_index.emplace(&worker, static_cast<std::uint32_t>(senders.size()));
+        senders.push_back(&worker);
+        refs.push_back({ElementType::WORKER, worker.get_id()});
     }
-
-    for (const auto& [receiver, probability] : pref) {
-        switch (receiver->get_receiver_type()) {
-            case ReceiverType::STOREHOUSE:
-                return true;
-
-            case ReceiverType::WORKER: {
-                auto* worker_ptr = dynamic_cast<Worker*>(receiver);
-                if (!worker_ptr) continue;
-                auto* sendrecv_ptr = dynamic_cast<PackageSender*>(worker_ptr);
-
-                if (!sendrecv_ptr || sender == sendrecv_ptr) {
-                    continue;
-                }
-
-                if (colors_of_nodes[sendrecv_ptr] == NodeColor::UNVISITED && has_reachable_storehouse(sendrecv_ptr, colors_of_nodes)) {
-                    return true;
-                }
-
-                break;
-            }
+    std::size_t worker_count = senders.size();
+    for (const auto& ramp : ramps_) {
+        if (excluded.count(&ramp)) {
+            continue;
         }
+        senders.push_back(&ramp);
+        refs.push_back({ElementType::RAMP, ramp.get_id()});
     }
-
-    colors_of_nodes[sender] = NodeColor::VERIFIED;
-    throw std::logic_error("Magazyn nieosiągalny");
-    
-}
-
-
-template<typename Node>
-typename NodeCollection<Node>::const_iterator NodeCollection<Node>::find_by_id(ElementID id) const {
-    for(auto iter = c_.cbegin(); iter != c_.cend(); ++iter){
-        if (iter->get_id() == id)
-            return iter;
+    sender_count = senders.size();
+
+    ConsistencyReport report;
+    std::vector<std::uint32_t> offsets(sender_count + 1, 0);
+    std::vector<std::uint32_t> targets;
+    std::vector<std::uint32_t> in_degree(worker_count, 0);
+    std::vector<char> reaches_storehouse(sender_count, 0);
+
+    for (std::size_t s = 0; s < sender_count; ++s) {
+        const auto& prefs = senders[s]->receiver_preferences_.get_preferences();
+        if (prefs.empty()) {
+            report.senders_without_receivers.push_back(refs[s]);
+        }
+        for (const auto& [receiver, probability] : prefs) {
+            if (receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
+                reaches_storehouse[s] = 1;
+                continue;
+            }
+            std::uint32_t target = worker_index.at(receiver);
+            if (target == s) {
+                report.self_linked_workers.push_back(refs[s].id);
+                continue;
+            }
+            targets.push_back(target);
+            ++in_degree[target];
+        }
+        offsets[s + 1] = static_cast<std::uint32_t>(targets.size());
     }
 
-    return c_.cend();
-}
-
-
-template<typename Node>
-typename NodeCollection<Node>::iterator NodeCollection<Node>::find_by_id(ElementID id){
-    for(auto iter = c_.begin(); iter != c_.end(); ++iter){
-        if (iter->get_id() == id)
-            return iter;
+    std::vector<std::uint32_t> reverse_offsets(worker_count + 1, 0);
+    for (std::size_t w = 0; w < worker_count; ++w) {
+        reverse_offsets[w + 1] = reverse_offsets[w] + in_degree[w];
     }
-
-    return c_.end();
-}
-
-
-void Factory::remove_storehouse(ElementID id) {
-    Storehouse* storehouse = storehouses_.find_by_id(id) != storehouses_.cend() ? &(*storehouses_.find_by_id(id)) : nullptr;
-    
-    for(auto& el : ramps_) {
-        el.receiver_preferences_.remove_receiver(storehouse);
+    std::vector<std::uint32_t> sources(targets.size());
+    std::vector<std::uint32_t> fill(reverse_offsets.begin(), reverse_offsets.end() - 1);
+    for (std::size_t s = 0; s < sender_count; ++s) {
+        for (std::uint32_t e = offsets[s]; e < offsets[s + 1]; ++e) {
+            sources[fill[targets[e]]++] = static_cast<std::uint32_t>(s);
+        }
     }
 
-    for(auto& el : workers_) {
-        el.receiver_preferences_.remove_receiver(storehouse);
+    std::vector<std::uint32_t> pending;
+    for (std::size_t s = 0; s < sender_count; ++s) {
+        if (reaches_storehouse[s]) {
+            pending.push_back(static_cast<std::uint32_t>(s));
+        }
     }
-
-    storehouses_.remove_by_id(id);
-}
-
-
-void Factory::remove_worker(ElementID id) {
-    Worker* worker = workers_.find_by_id(id) != workers_.cend() ? &(*workers_.find_by_id(id)) : nullptr;
-    
-    for(auto& el : ramps_) {
-        el.receiver_preferences_.remove_receiver(worker);
+    while (!pending.empty()) {
+        std::uint32_t s = pending.back();
+        pending.pop_back();
+        if (s >= worker_count) {
+            continue;
+        }
+        for (std::uint32_t e = reverse_offsets[s]; e < reverse_offsets[s + 1]; ++e) {
+            if (!reaches_storehouse[sources[e]]) {
+                reaches_storehouse[sources[e]] = 1;
+                pending.push_back(sources[e]);
+            }
+        }
     }
 
-    for(auto& el : workers_) {
-        el.receiver_preferences_.remove_receiver(worker);
+    std::vector<char> fed(sender_count, 0);
+    for (std::size_t r = worker_count; r < sender_count; ++r) {
+        fed[r] = 1;
+        pending.push_back(static_cast<std::uint32_t>(r));
     }
-
-    workers_.remove_by_id(id);
-}
-
-
-bool Factory::is_consistent() const {
-    std::map<const PackageSender*, NodeColor> colour;
-
-    auto set_unvisited_colours = [&colour](const auto& cont) {
-        for (const auto& item : cont) {
-            if (const PackageSender* sender = dynamic_cast<const PackageSender*>(&item)) {
-                colour[sender] = NodeColor::UNVISITED;
+    while (!pending.empty()) {
+        std::uint32_t s = pending.back();
+        pending.pop_back();
+        for (std::uint32_t e = offsets[s]; e < offsets[s + 1]; ++e) {
+            if (!fed[targets[e]]) {
+                fed[targets[e]] = 1;
+                pending.push_back(targets[e]);
             }
         }
-    };
-
-    set_unvisited_colours(ramps_);
-    set_unvisited_colours(workers_);
+    }
 
-    try {
-        for (auto& el : ramps_) {
-            has_reachable_storehouse(dynamic_cast<const PackageSender*>(&el), colour);
+    for (std::size_t s = 0; s < sender_count; ++s) {
+        if (fed[s] && !reaches_storehouse[s]) {
+            report.senders_without_storehouse.push_back(refs[s]);
         }
-    } catch (std::logic_error&) {
-        return false;
     }
 
-    return true;
+    return report;
 }
 
 
-void Factory::do_deliveries(Time time) {
-    for(auto& el : ramps_){
-        el.deliver_goods(time);
+PackageSender* Factory::find_sender(NodeRef node) {
+    if (node.elem_type == ElementType::RAMP) {
+        auto it = ramps_.find_by_id(node.id);
+        if (it != ramps_.end()) {
+            return &*it;
+        }
+    } else if (node.elem_type == ElementType::WORKER) {
+        auto it = workers_.find_by_id(node.id);
+        if (it != workers_.end()) {
+            return &*it;
+        }
     }
+    throw std::invalid_argument("Brak nadawcy o identyfikatorze " + std::to_string(node.id));
 }
 
 
-void Factory::do_package_passing() {
-    for(auto& el : workers_) {
-        el.send_package();
-    }
-    for(auto& el : ramps_) {
-        el.send_package();
+IPackageReceiver* Factory::find_receiver(NodeRef node) {
+    if (node.elem_type == ElementType::WORKER) {
+        auto it = workers_.find_by_id(node.id);
+        if (it != workers_.end()) {
+            return &*it;
+        }
+    } else if (node.elem_type == ElementType::STOREHOUSE) {
+        auto it = storehouses_.find_by_id(node.id);
+        if (it != storehouses_.end()) {
+            return &*it;
+        }
     }
+    throw std::invalid_argument("Brak odbiorcy o identyfikatorze " + std::to_string(node.id));
 }
 
 
-void Factory::do_work(Time time) {
-    for (auto& el : workers_){
-        el.do_work(time);
+void Factory::remove_node(NodeRef node) {
+    switch (node.elem_type) {
+        case ElementType::RAMP:
+            remove_ramp(node.id);
+            break;
+        case ElementType::WORKER:
+            remove_worker(node.id);
+            break;
+        case ElementType::STOREHOUSE:
+            remove_storehouse(node.id);
+            break;
+        default:
+            break;
     }
 }
 
 
+ConsistencyReport Factory::apply(StructureEdit&& edit) {
+    // Every link change is logged with the weight it replaced (0 when there was no link),
+    // so the batch can be undone exactly; removed nodes stay alive until the check passes.
+    struct LinkUndo {
+        ReceiverPreferences* preferences;
+        IPackageReceiver* receiver;
+        double weight;
+    };
+    std::vector<LinkUndo> undo_log;
+    std::vector<NodeRef> added;
+    std::unordered_set<const PackageSender*> excluded;
+
+    auto set_link = [&undo_log](ReceiverPreferences& preferences, IPackageReceiver* receiver, double weight) {
+        const auto& weights = preferences.get_weights();
+        auto found = weights.find(receiver);
+        undo_log.push_back({&preferences, receiver, found != weights.end() ? found->second : 0.0});
+        if (weight > 0.0) {
+            preferences.add_receiver(receiver, weight);
+        } else {
+            preferences.remove_receiver(receiver);
+        }
+    };
 
-template<typename Node>
-void Factory::remove_receiver(NodeCollection<Node>& collection, ElementID id) {
-
-    auto iterator = collection.find_by_id(id);
-    auto rec_ptr = dynamic_cast<IPackageReceiver*>(iterator);
-
-    auto remove_receiver_from_prefs = [&](auto& container) {
-        for (auto& element : container) {
-            auto& prefs = element.receiver_preferences_.get_preferences();
-            for (auto& pref : prefs) {
-                if (rec_ptr == pref.first) {
-                    element.receiver_preferences_.remove_receiver(rec_ptr);
-                    break;
-                }
+    auto rollback = [&]() {
+        for (auto it = undo_log.rbegin(); it != undo_log.rend(); ++it) {
+            if (it->weight > 0.0) {
+                it->preferences->add_receiver(it->receiver, it->weight);
+            } else {
+                it->preferences->remove_receiver(it->receiver);
             }
         }
+        for (auto it = added.rbegin(); it != added.rend(); ++it) {
+            remove_node(*it);
+        }
     };
 
-    remove_receiver_from_prefs(workers_);
-    remove_receiver_from_prefs(ramps_);
-}
+    ConsistencyReport report;
+    try {
+        for (auto& ramp : edit.ramps_) {
+            ElementID id = ramp.get_id();
+            Ramp& added_ramp = ramps_.add(std::move(ramp));
+            attach_metrics(added_ramp);
+            seed_node(added_ramp);
+            added.push_back({ElementType::RAMP, id});
+        }
+        for (auto& worker : edit.workers_) {
+            ElementID id = worker.get_id();
+            Worker& added_worker = workers_.add(std::move(worker));
+            attach_metrics(added_worker);
+            seed_node(added_worker);
+            added.push_back({ElementType::WORKER, id});
+        }
+        for (auto& storehouse : edit.storehouses_) {
+            ElementID id = storehouse.get_id();
+            attach_metrics(storehouses_.add(std::move(storehouse)));
+            added.push_back({ElementType::STOREHOUSE, id});
+        }
+        node_index_stale_ = true;
 
+        for (const auto& change : edit.links_) {
+            if (!change.unlink && !(change.weight > 0.0)) {
+                throw std::invalid_argument("Waga odbiorcy musi być dodatnia");
+            }
+            set_link(find_sender(change.sender)->receiver_preferences_, find_receiver(change.receiver), change.unlink ? 0.0 : change.weight);
+        }
+
+        for (const auto& node : edit.removed_) {
+            PackageSender* sender = nullptr;
+            IPackageReceiver* receiver = nullptr;
+            if (node.elem_type == ElementType::RAMP) {
+                auto it = ramps_.find_by_id(node.id);
+                sender = it != ramps_.end() ? &*it : nullptr;
+            } else if (node.elem_type == ElementType::WORKER) {
+                auto it = workers_.find_by_id(node.id);
+                sender = it != workers_.end() ? &*it : nullptr;
+                receiver = it != workers_.end() ? &*it : nullptr;
+            } else if (node.elem_type == ElementType::STOREHOUSE) {
+                auto it = storehouses_.find_by_id(node.id);
+                receiver = it != storehouses_.end() ? &*it : nullptr;
+            }
 
-std::vector<std::string> char_split(const std::string& splittable_str, char delimiter) {
-    std::vector<std::string> characters_splitted;
-    std::string element;
-    
-    for (char c : splittable_str) {
-        if (c == delimiter) {
-            if (!element.empty()) {
-                characters_splitted.emplace_back(element);
-                element.clear();
+            if (receiver) {
+                std::vector<ReceiverPreferences*> senders = receiver->get_senders();
+                for (ReceiverPreferences* preferences : senders) {
+                    set_link(*preferences, receiver, 0.0);
+                }
+            }
+            if (sender) {
+                std::vector<IPackageReceiver*> receivers;
+                for (const auto& [linked, weight] : sender->receiver_preferences_.get_weights()) {
+                    receivers.push_back(linked);
+                }
+                for (IPackageReceiver* linked : receivers) {
+                    set_link(sender->receiver_preferences_, linked, 0.0);
+                }
+                excluded.insert(sender);
             }
-        } 
-        else {
-            element += c;
         }
+
+        report = check_consistency(excluded);
+    } catch (...) {
+        rollback();
+        throw;
     }
 
-    if (!element.empty()) {
-        characters_splitted.emplace_back(element);
+    if (!report.is_consistent()) {
+        rollback();
+        return report;
     }
 
-    return characters_splitted;
+    for (const auto& node : edit.removed_) {
+        remove_node(node);
+    }
+    return report;
 }
 
 
-ParsedLineData parse_line(std::string& line) {
-    std::vector<std::string> parts;
-    std::string current_part;
-
-    std::istringstream input_stream(line);
-    char split_char = ' ';
+namespace {
 
-    while (std::getline(input_stream, current_part, split_char))
-        parts.push_back(current_part);
+// Next to the streams of drawn durations (see Ramp and Worker).
+constexpr std::uint64_t RAMP_ROUTING_STREAM = std::uint64_t(3) << 32;
+constexpr std::uint64_t WORKER_ROUTING_STREAM = std::uint64_t(4) << 32;
 
-    const std::map<std::string, ElementType> element_type_map = {
-            {"LINK", ElementType::LINK},
-            {"LOADING_RAMP", ElementType::RAMP},
-            {"WORKER", ElementType::WORKER},
-            {"STOREHOUSE", ElementType::STOREHOUSE},
-    };
+std::uint64_t routing_stream(const Ramp& ramp) {
+    return RAMP_ROUTING_STREAM | static_cast<std::uint32_t>(ramp.get_id());
+}
 
-    if (parts.empty()) {
-        throw std::invalid_argument("Wejście jest puste");
-    }
+std::uint64_t routing_stream(const Worker& worker) {
+    return WORKER_ROUTING_STREAM | static_cast<std::uint32_t>(worker.get_id());
+}
 
-    ParsedLineData parsed_result;
+std::shared_ptr<std::pmr::memory_resource> structure_resource(const std::shared_ptr<FactoryMemory>& memory) {
+    return memory ? std::shared_ptr<std::pmr::memory_resource>(memory, memory->get_structure_resource()) : nullptr;
+}
 
-    try {
-        parsed_result.elem_type = element_type_map.at(parts.front());
+}
 
-        for (size_t i = 1; i < parts.size(); ++i) {
-            const auto key_value_pair = char_split(parts[i], '=');
-            
-            if (key_value_pair.size() != 2) {
-                throw std::logic_error("Nieprawidłowy format klucz=wartość: " + parts[i]);
-            }
-            parsed_result.params[key_value_pair[0]] = key_value_pair[1];
-        }
-    } catch (const std::out_of_range&) {
-        throw std::logic_error("Niewłaściwy typ danych wejścia");
-    }
 
-    return parsed_result;
-}
+Factory::Factory(std::shared_ptr<FactoryMemory> memory)
+    : memory_(std::move(memory)), storehouses_(structure_resource(memory_)), ramps_(structure_resource(memory_)), workers_(structure_resource(memory_)) {}
 
-PackageQueueType get_queue_type_of_package(std::string& string_package_queue) {
-    std::map<std::string, PackageQueueType> str_type{
-            {"FIFO", PackageQueueType::FIFO},
-            {"LIFO", PackageQueueType::LIFO},
-    };
 
-    return str_type.at(string_package_queue);
+void Factory::set_metrics(std::shared_ptr<FactoryMetrics> metrics) {
+    metrics_ = std::move(metrics);
+    for (auto& el : ramps_) {
+        attach_metrics(el);
+    }
+    for (auto& el : workers_) {
+        attach_metrics(el);
+    }
+    for (auto& el : storehouses_) {
+        attach_metrics(el);
+    }
 }
 
 
-void link(Factory& factory, const std::map<std::string, std::string>& parameters) {
-    enum class NodeType {
-        RAMP, WORKER, STORE
-    };
+void Factory::set_random_seed(std::uint64_t seed) {
+    random_seed_ = seed;
+    for (auto& el : ramps_) {
+        el.seed_durations(seed);
+    }
+    for (auto& el : workers_) {
+        el.seed_durations(seed);
+    }
+}
 
-    const std::map<std::string, NodeType> node_type_map{
-            {"ramp", NodeType::RAMP},
-            {"worker", NodeType::WORKER},
-            {"store", NodeType::STORE}
-    };
 
-    std::string src_str = parameters.at("src");
-    auto src_parts = char_split(src_str, '-');
-    NodeType src_node_type = node_type_map.at(src_parts[0]);
-    ElementID src_node_id = std::stoi(src_parts[1]);
+void Factory::set_routing_seed(std::uint64_t seed) {
+    routing_seed_ = seed;
+    for (auto& el : ramps_) {
+        el.receiver_preferences_.use_stream(seed, routing_stream(el));
+    }
+    for (auto& el : workers_) {
+        el.receiver_preferences_.use_stream(seed, routing_stream(el));
+    }
+}
 
-    std::string dest_str = parameters.at("dest");
-    auto dest_parts = char_split(dest_str, '-');
-    NodeType dest_node_type = node_type_map.at(dest_parts[0]);
-    ElementID dest_node_id = std::stoi(dest_parts[1]);
 
-    IPackageReceiver* receiver = nullptr;
-    if (dest_node_type == NodeType::WORKER) {
-        receiver = &*factory.find_worker_by_id(dest_node_id);
-    } else if (dest_node_type == NodeType::STORE) {
-        receiver = &*factory.find_storehouse_by_id(dest_node_id);
+void Factory::seed_node(Ramp& ramp) {
+    ramp.seed_durations(random_seed_);
+    if (routing_seed_) {
+        ramp.receiver_preferences_.use_stream(*routing_seed_, routing_stream(ramp));
     }
+}
+
 
-    if (src_node_type == NodeType::RAMP) {
-        factory.find_ramp_by_id(src_node_id)->receiver_preferences_.add_receiver(receiver);
-    } else if (src_node_type == NodeType::WORKER) {
-        factory.find_worker_by_id(src_node_id)->receiver_preferences_.add_receiver(receiver);
+void Factory::seed_node(Worker& worker) {
+    worker.seed_durations(random_seed_);
+    if (routing_seed_) {
+        worker.receiver_preferences_.use_stream(*routing_seed_, routing_stream(worker));
     }
 }
 
 
-std::string queue_type(PackageQueueType package_queue_type) {
-    if (package_queue_type == PackageQueueType::FIFO) {
-        return "FIFO";
-    } else if (package_queue_type == PackageQueueType::LIFO) {
-        return "LIFO";
-    }
-    return {};
+void Factory::attach_metrics(Ramp& ramp) {
+    ramp.attach_metrics(metrics_ ? MetricsHandle(metrics_.get(), metrics_->add_node(MetricsNodeKind::RAMP, ramp.get_id())) : MetricsHandle());
 }
 
 
-void link_fill(std::stringstream& output_stream, const PackageSender& sender, ElementID sender_id, std::string&& sender_name) {
-    const auto& preferences = sender.receiver_preferences_.get_preferences();
+void Factory::attach_metrics(Worker& worker) {
+    worker.attach_metrics(metrics_ ? MetricsHandle(metrics_.get(), metrics_->add_node(MetricsNodeKind::WORKER, worker.get_id(), worker.get_queue()->size(),
+                                                                                          worker.get_servers()))
+                                   : MetricsHandle());
+}
 
-    for (const auto& [receiver, preference] : preferences) {
-        output_stream << "LINK src=" << sender_name << "-" << sender_id << " ";
 
-        ReceiverType receiver_type = receiver->get_receiver_type();
-        std::string receiver_type_str = (receiver_type == ReceiverType::WORKER) ? "worker" : "store";
+void Factory::attach_metrics(Storehouse& storehouse) {
+    storehouse.attach_metrics(metrics_ ? MetricsHandle(metrics_.get(), metrics_->add_node(MetricsNodeKind::STOREHOUSE, storehouse.get_id()))
+                                       : MetricsHandle());
+}
 
-        output_stream << "dest=" << receiver_type_str << "-" << receiver->get_id() << '\n';
-        std::cout << output_stream.str();
+
+void Factory::do_deliveries(Time time) {
+    if (metrics_) {
+        metrics_->begin_turn(time);
+    }
+    Package::get_payload_arena().begin_turn(time);
+    for(auto& el : ramps_){
+        el.deliver_goods(time);
     }
 }
 
 
-Factory load_factory_structure(std::istream& input_stream) {
-    Factory factory;
-
-    std::string current_line;
-    std::vector<std::string> relevant_lines;
+void Factory::refresh_node_index() {
+    worker_index_.clear();
+    receiver_index_.clear();
+    receiver_slots_.clear();
 
-    for (std::string line_buffer; std::getline(input_stream, line_buffer);) {
-        if (!line_buffer.empty() && line_buffer[0] != ';') {
-            relevant_lines.push_back(line_buffer);
-        }
+    for (auto& el : workers_) {
+        worker_index_.push_back(&el);
+        receiver_slots_[&el] = receiver_index_.size();
+        receiver_index_.push_back(&el);
+    }
+    for (auto& el : storehouses_) {
+        receiver_slots_[&el] = receiver_index_.size();
+        receiver_index_.push_back(&el);
     }
 
-    for (auto& single_line : relevant_lines) {
-        ParsedLineData parsed_data = parse_line(single_line);
+    staged_packages_.resize(receiver_index_.size());
+    node_index_stale_ = false;
+}
 
-        if (parsed_data.elem_type == ElementType::LINK) {
-            link(factory, parsed_data.params);
 
-        } else if (parsed_data.elem_type == ElementType::WORKER) {
-            ElementID worker_id = std::stoi(parsed_data.params.at("id"));
-            TimeOffset worker_processing_time = std::stoi(parsed_data.params.at("processing-time"));
-            PackageQueueType worker_queue_type = get_queue_type_of_package(parsed_data.params.at("queue-type"));
-            Worker new_worker(worker_id, worker_processing_time, std::make_unique<PackageQueue>(worker_queue_type));
-            factory.add_worker(std::move(new_worker));
+void Factory::do_package_passing() {
+    if (!thread_pool_) {
+        for(auto& el : workers_) {
+            while (el.send_package() && el.load_next_finished()) {
+            }
+        }
+        for(auto& el : ramps_) {
+            el.send_package();
+        }
+        return;
+    }
 
-        } else if (parsed_data.elem_type == ElementType::STOREHOUSE) {
-            ElementID storehouse_id = std::stoi(parsed_data.params.at("id"));
-            Storehouse new_storehouse(storehouse_id);
-            factory.add_storehouse(std::move(new_storehouse));
+    if (node_index_stale_) {
+        refresh_node_index();
+    }
 
-        } else if (parsed_data.elem_type == ElementType::RAMP) {
-            ElementID ramp_id = std::stoi(parsed_data.params.at("id"));
-            TimeOffset ramp_delivery_interval = std::stoi(parsed_data.params.at("delivery-interval"));
-            Ramp new_ramp(ramp_id, ramp_delivery_interval);
-            factory.add_ramp(std::move(new_ramp));
+    // Receivers are drawn serially in the serial visiting order, since every ReceiverPreferences
+    // may share one probability stream; only the pushes into the receivers run in parallel.
+    auto stage = [this](const ReceiverHandle& receiver, Package&& package) {
+        std::vector<Package>& staged = staged_packages_[receiver_slots_.at(receiver.get())];
+        if (!receiver.has_room(staged.size())) {
+            return false;
+        }
+        staged.push_back(std::move(package));
+        return true;
+    };
+    for(auto& el : workers_) {
+        while (el.send_package(stage) && el.load_next_finished()) {
         }
     }
+    for(auto& el : ramps_) {
+        el.send_package(stage);
+    }
 
-    return factory;
+    thread_pool_->parallel_for(receiver_index_.size(), [this](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            for (auto& package : staged_packages_[i]) {
+                receiver_index_[i]->receive_package(std::move(package));
+            }
+            staged_packages_[i].clear();
+        }
+    });
 }
 
 
-void save_factory_structure(Factory& factory, std::ostream& output_stream) {
-    std::stringstream link_stream;
-
-    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
-        const auto& ramp = *it;
-        ElementID ramp_id = ramp.get_id();
-        output_stream << "LOADING_RAMP id=" << ramp_id << ' '
-                      << "delivery-interval=" << ramp.get_delivery_interval() << '\n';
-
-        link_fill(link_stream, ramp, ramp_id, "ramp");
+void Factory::do_work(Time time) {
+    if (!thread_pool_) {
+        for (auto& el : workers_){
+            el.do_work(time);
+        }
+        return;
     }
 
-    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
-        const auto& worker = *it;
-        PackageQueueType queue_t = worker.get_queue()->get_queue_type();
-        ElementID worker_id = worker.get_id();
-        output_stream << "WORKER id=" << worker_id << ' '
-                << "processing-time=" << worker.get_processing_duration() << ' '
-                      << "queue-type=" << queue_type(queue_t) << '\n';
-
-        link_fill(link_stream, worker, worker_id, "worker");
+    if (node_index_stale_) {
+        refresh_node_index();
     }
 
-    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
-        const auto& storehouse = *it;
-        output_stream << "STOREHOUSE id=" << storehouse.get_id() << '\n';
-    }
-    
-    output_stream << link_stream.str();
-    output_stream.flush();
-}
\ No newline at end of file
+    thread_pool_->parallel_for(worker_index_.size(), [this, time](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            worker_index_[i]->do_work(time);
+        }
+    });
+}
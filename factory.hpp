@@ -2,12 +2,13 @@
 #define FACTORY_HPP
 
 #include <bits/stdc++.h>
-#include "nodes.hxx"
-#include "storage_types.hxx"
+#include "nodes.hpp"
+#include "storage_types.hpp"
+#include "thread_pool.hpp"
+#include "metrics.hpp"
+#include "factory_memory.hpp"
 
 
-bool has_reachable_storehouse(const PackageSender* sender, std::map<const PackageSender*, NodeColor>& colors_of_nodes);
-
 class Node {
 public:
     virtual ~Node() = default;
@@ -17,79 +18,344 @@ enum class ElementType {
     LINK, STOREHOUSE, RAMP, WORKER 
 };
 
-struct ParsedLineData {
+struct NodeRef {
     ElementType elem_type;
-    std::map<std::string, std::string> params;
+    ElementID id;
 };
 
-ParsedLineData parse_line(std::string& line);
 
+struct ConsistencyReport {
+    std::vector<NodeRef> senders_without_receivers;
+    // senders fed (directly or not) by a ramp from which no storehouse can be reached
+    std::vector<NodeRef> senders_without_storehouse;
+    std::vector<ElementID> self_linked_workers;
+
+    bool is_consistent() const { return senders_without_storehouse.empty(); }
+};
+
+
+// A batch of structure changes, applied by Factory::apply as a single transaction.
+// Nodes are referred to by NodeRef and may be ones added in the same batch.
+class StructureEdit {
+public:
+    void add_ramp(Ramp&& ramp) { ramps_.push_back(std::move(ramp)); }
+    void add_worker(Worker&& worker) { workers_.push_back(std::move(worker)); }
+    void add_storehouse(Storehouse&& storehouse) { storehouses_.push_back(std::move(storehouse)); }
+    void remove(NodeRef node) { removed_.push_back(node); }
+
+    void link(NodeRef sender, NodeRef receiver, double weight = 1.0) { links_.push_back({sender, receiver, weight, false}); }
+    void unlink(NodeRef sender, NodeRef receiver) { links_.push_back({sender, receiver, 0.0, true}); }
+
+private:
+    friend class Factory;
+
+    struct LinkChange {
+        NodeRef sender;
+        NodeRef receiver;
+        double weight;
+        bool unlink;
+    };
+
+    std::vector<Ramp> ramps_;
+    std::vector<Worker> workers_;
+    std::vector<Storehouse> storehouses_;
+    std::vector<LinkChange> links_;
+    std::vector<NodeRef> removed_;
+};
+
+// Nodes live in fixed-size chunks that never move, so pointers to them (e.g. the ones kept by
+// ReceiverPreferences) stay valid until removal. An ID index gives O(1) lookup and removal,
+// and slots are threaded into a list that preserves insertion order for iteration.
+// Chunks come from the given memory resource (the default one if none), which the collection keeps alive.
 template<typename Node>
 class NodeCollection {
+    static constexpr std::size_t NIL = static_cast<std::size_t>(-1);
+    static constexpr std::size_t CHUNK_SIZE = 64;
+
+    struct Slot {
+        alignas(Node) unsigned char storage[sizeof(Node)];
+        std::size_t prev = NIL;
+        std::size_t next = NIL;
+
+        Node& node() { return *std::launder(reinterpret_cast<Node*>(storage)); }
+    };
+
+    template<bool Const>
+    class NodeIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Node;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const Node*, Node*>;
+        using reference = std::conditional_t<Const, const Node&, Node&>;
+        using collection_t = std::conditional_t<Const, const NodeCollection, NodeCollection>;
+
+        NodeIterator() = default;
+        NodeIterator(collection_t* collection, std::size_t index) : collection_(collection), index_(index) {}
+        template<bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        NodeIterator(const NodeIterator<OtherConst>& other) : collection_(other.collection_), index_(other.index_) {}
+
+        reference operator*() const { return collection_->slot(index_).node(); }
+        pointer operator->() const { return &**this; }
+        NodeIterator& operator++() { index_ = collection_->slot(index_).next; return *this; }
+        NodeIterator operator++(int) { NodeIterator copy = *this; ++*this; return copy; }
+
+        template<bool OtherConst>
+        bool operator==(const NodeIterator<OtherConst>& other) const { return index_ == other.index_; }
+        template<bool OtherConst>
+        bool operator!=(const NodeIterator<OtherConst>& other) const { return index_ != other.index_; }
+
+    private:
+        template<bool> friend class NodeIterator;
+
+        collection_t* collection_ = nullptr;
+        std::size_t index_ = NIL;
+    };
+
 public:
-    using container_t = typename std::list<Node>;
-    using const_iterator = typename container_t::const_iterator;
-    using iterator = typename container_t::iterator;
+    using const_iterator = NodeIterator<true>;
+    using iterator = NodeIterator<false>;
 
+    NodeCollection() = default;
+    explicit NodeCollection(std::shared_ptr<std::pmr::memory_resource> resource) : resource_(std::move(resource)) {}
+    NodeCollection(const NodeCollection&) = delete;
+    NodeCollection& operator=(const NodeCollection&) = delete;
+    NodeCollection(NodeCollection&& other) noexcept { swap(other); }
+    NodeCollection& operator=(NodeCollection&& other) noexcept { NodeCollection moved(std::move(other)); swap(moved); return *this; }
+    ~NodeCollection() { clear(); }
 
-    iterator begin() { return c_.begin(); }
-    const_iterator begin() const { return c_.cbegin(); }
-    const_iterator cbegin() const { return c_.cbegin(); }
+    iterator begin() { return iterator(this, head_); }
+    const_iterator begin() const { return const_iterator(this, head_); }
+    const_iterator cbegin() const { return const_iterator(this, head_); }
 
-    iterator end() { return c_.end(); }
-    const_iterator end() const { return c_.cend(); }
-    const_iterator cend() const { return c_.cend(); }
+    iterator end() { return iterator(this, NIL); }
+    const_iterator end() const { return const_iterator(this, NIL); }
+    const_iterator cend() const { return const_iterator(this, NIL); }
 
+    std::size_t size() const { return index_.size(); }
+    bool empty() const { return index_.empty(); }
 
-    void add(Node&& node) { c_.push_back(std::move(node)); }
-    void remove_by_id(ElementID id) { c_.remove_if([id](const Node& n) { return n.get_id() == id; }); }
+    Node& add(Node&& node);
+    void remove_by_id(ElementID id);
 
     NodeCollection<Node>::const_iterator find_by_id(ElementID id) const;
     NodeCollection<Node>::iterator find_by_id(ElementID id);
 
 private:
-    container_t c_;
+    Slot& slot(std::size_t index) const { return chunks_[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+    std::pmr::memory_resource* resource() const { return resource_ ? resource_.get() : std::pmr::get_default_resource(); }
+    void clear();
+    void swap(NodeCollection& other) noexcept;
+
+    std::shared_ptr<std::pmr::memory_resource> resource_;
+    std::vector<Slot*> chunks_;
+    std::vector<std::size_t> free_slots_;
+    std::unordered_map<ElementID, std::size_t> index_;
+    std::size_t slot_count_ = 0;
+    std::size_t head_ = NIL;
+    std::size_t tail_ = NIL;
 };
 
 
+template<typename Node>
+Node& NodeCollection<Node>::add(Node&& node) {
+    ElementID id = node.get_id();
+    if (index_.count(id)) {
+        throw std::invalid_argument("Węzeł o identyfikatorze " + std::to_string(id) + " już istnieje");
+    }
+
+    std::size_t index;
+    if (!free_slots_.empty()) {
+        index = free_slots_.back();
+        free_slots_.pop_back();
+    } else {
+        if (slot_count_ % CHUNK_SIZE == 0) {
+            chunks_.reserve(chunks_.size() + 1);
+            auto chunk = static_cast<Slot*>(resource()->allocate(CHUNK_SIZE * sizeof(Slot), alignof(Slot)));
+            for (std::size_t i = 0; i < CHUNK_SIZE; ++i) {
+                new (chunk + i) Slot();
+            }
+            chunks_.push_back(chunk);
+        }
+        index = slot_count_++;
+    }
+
+    Slot& s = slot(index);
+    new (s.storage) Node(std::move(node));
+    s.prev = tail_;
+    s.next = NIL;
+    if (tail_ != NIL) {
+        slot(tail_).next = index;
+    } else {
+        head_ = index;
+    }
+    tail_ = index;
+    index_.emplace(id, index);
+    return s.node();
+}
+
+
+template<typename Node>
+void NodeCollection<Node>::remove_by_id(ElementID id) {
+    auto found = index_.find(id);
+    if (found == index_.end()) {
+        return;
+    }
+    std::size_t index = found->second;
+    index_.erase(found);
+
+    Slot& s = slot(index);
+    (s.prev != NIL ? slot(s.prev).next : head_) = s.next;
+    (s.next != NIL ? slot(s.next).prev : tail_) = s.prev;
+    s.node().~Node();
+    free_slots_.push_back(index);
+}
+
+
+template<typename Node>
+typename NodeCollection<Node>::const_iterator NodeCollection<Node>::find_by_id(ElementID id) const {
+    auto found = index_.find(id);
+    return const_iterator(this, found != index_.end() ? found->second : NIL);
+}
+
+
+template<typename Node>
+typename NodeCollection<Node>::iterator NodeCollection<Node>::find_by_id(ElementID id) {
+    auto found = index_.find(id);
+    return iterator(this, found != index_.end() ? found->second : NIL);
+}
+
+
+template<typename Node>
+void NodeCollection<Node>::clear() {
+    for (std::size_t index = head_; index != NIL; index = slot(index).next) {
+        slot(index).node().~Node();
+    }
+    for (Slot* chunk : chunks_) {
+        resource()->deallocate(chunk, CHUNK_SIZE * sizeof(Slot), alignof(Slot));
+    }
+    chunks_.clear();
+    free_slots_.clear();
+    index_.clear();
+    slot_count_ = 0;
+    head_ = tail_ = NIL;
+}
+
+
+template<typename Node>
+void NodeCollection<Node>::swap(NodeCollection& other) noexcept {
+    std::swap(resource_, other.resource_);
+    std::swap(chunks_, other.chunks_);
+    std::swap(free_slots_, other.free_slots_);
+    std::swap(index_, other.index_);
+    std::swap(slot_count_, other.slot_count_);
+    std::swap(head_, other.head_);
+    std::swap(tail_, other.tail_);
+}
+
+
 class Factory {
 public:
-    void add_storehouse(Storehouse&& storehouse) { storehouses_.add(std::move(storehouse)); }
-    void remove_storehouse(ElementID id);
+    Factory() = default;
+    // Nodes and queues of the factory are then allocated from memory (see FactoryMemory).
+    explicit Factory(std::shared_ptr<FactoryMemory> memory);
+
+    // Where queues of nodes added to this factory should allocate; the default resource without FactoryMemory.
+    std::pmr::memory_resource* get_package_resource() const { return memory_ ? memory_->get_package_resource() : std::pmr::get_default_resource(); }
+
+    void add_storehouse(Storehouse&& storehouse) { attach_metrics(storehouses_.add(std::move(storehouse))); node_index_stale_ = true; }
+    // Destroying a node unlinks it from its senders and receivers, so removal costs O(degree).
+    void remove_storehouse(ElementID id) { storehouses_.remove_by_id(id); release_metrics(MetricsNodeKind::STOREHOUSE, id); node_index_stale_ = true; }
     NodeCollection<Storehouse>::const_iterator find_storehouse_by_id(ElementID id) const { return storehouses_.find_by_id(id); }
     NodeCollection<Storehouse>::iterator find_storehouse_by_id(ElementID id) { return storehouses_.find_by_id(id); }
     NodeCollection<Storehouse>::const_iterator storehouse_cbegin() const { return storehouses_.cbegin(); }
     NodeCollection<Storehouse>::const_iterator storehouse_cend() const { return storehouses_.cend(); }
+    NodeCollection<Storehouse>::iterator storehouse_begin() { return storehouses_.begin(); }
+    NodeCollection<Storehouse>::iterator storehouse_end() { return storehouses_.end(); }
 
-    void add_ramp(Ramp&& ramp) { ramps_.add(std::move(ramp)); }
-    void remove_ramp(ElementID id) { ramps_.remove_by_id(id); }
+    void add_ramp(Ramp&& ramp) { Ramp& added = ramps_.add(std::move(ramp)); attach_metrics(added); seed_node(added); }
+    void remove_ramp(ElementID id) { ramps_.remove_by_id(id); release_metrics(MetricsNodeKind::RAMP, id); }
     NodeCollection<Ramp>::const_iterator find_ramp_by_id(ElementID id) const { return ramps_.find_by_id(id); }
     NodeCollection<Ramp>::iterator find_ramp_by_id(ElementID id) { return ramps_.find_by_id(id); }
     NodeCollection<Ramp>::const_iterator ramp_cbegin() const { return ramps_.cbegin(); }
     NodeCollection<Ramp>::const_iterator ramp_cend() const { return ramps_.cend(); }
+    NodeCollection<Ramp>::iterator ramp_begin() { return ramps_.begin(); }
+    NodeCollection<Ramp>::iterator ramp_end() { return ramps_.end(); }
 
-    void add_worker(Worker&& worker) { workers_.add(std::move(worker)); }
-    void remove_worker(ElementID id);
+    void add_worker(Worker&& worker) { Worker& added = workers_.add(std::move(worker)); attach_metrics(added); seed_node(added); node_index_stale_ = true; }
+    void remove_worker(ElementID id) { workers_.remove_by_id(id); release_metrics(MetricsNodeKind::WORKER, id); node_index_stale_ = true; }
     NodeCollection<Worker>::const_iterator find_worker_by_id(ElementID id) const { return workers_.find_by_id(id); }
     NodeCollection<Worker>::iterator find_worker_by_id(ElementID id) { return workers_.find_by_id(id); }
     NodeCollection<Worker>::const_iterator worker_cbegin() const { return workers_.cbegin(); }
     NodeCollection<Worker>::const_iterator worker_cend() const { return workers_.cend(); }
+    NodeCollection<Worker>::iterator worker_begin() { return workers_.begin(); }
+    NodeCollection<Worker>::iterator worker_end() { return workers_.end(); }
 
-    bool is_consistent() const;
+    bool is_consistent() const { return check_consistency().is_consistent(); }
+    ConsistencyReport check_consistency() const { return check_consistency({}); }
+
+    // Applies the whole batch and checks consistency once. If an edit is invalid (an exception is
+    // thrown) or the result is inconsistent, every change is rolled back and the factory is left as it was.
+    ConsistencyReport apply(StructureEdit&& edit);
     void do_deliveries(Time time);
     void do_work(Time time);
     void do_package_passing();
 
+    // With a pool, do_work runs workers concurrently and do_package_passing delivers staged
+    // packages per receiver concurrently; results are identical to the serial run.
+    void set_thread_pool(std::shared_ptr<ThreadPool> pool) { thread_pool_ = std::move(pool); }
+
+    // Registers every node (and every node added later) with the metrics; nullptr detaches them.
+    // Each node has one slot in the metrics for as long as it stays in the factory.
+    // Only this object simulation is instrumented, FlatFactory and run_ensemble are not.
+    void set_metrics(std::shared_ptr<FactoryMetrics> metrics);
+    const std::shared_ptr<FactoryMetrics>& get_metrics() const { return metrics_; }
+
+    // Seeds the drawn processing times and delivery intervals of every node (and every node added
+    // later) and restarts their streams. Each node draws from its own stream keyed by its ID, so a
+    // seed gives the same run whatever the thread count or simulation mode.
+    void set_random_seed(std::uint64_t seed);
+    std::uint64_t get_random_seed() const { return random_seed_; }
+
+    // Gives every sender (and every sender added later) its own stream of routing draws keyed by
+    // its ID instead of the shared probability generator. Routing then no longer depends on the
+    // order in which senders are visited, which simulate_sharded relies on.
+    void set_routing_seed(std::uint64_t seed);
+    bool has_routing_streams() const { return routing_seed_.has_value(); }
+
 private:
+    std::shared_ptr<FactoryMemory> memory_;
     NodeCollection<Storehouse> storehouses_;
     NodeCollection<Ramp> ramps_;
     NodeCollection<Worker> workers_;
 
-    template<class Node>
-    void remove_receiver(NodeCollection<Node>& collection, ElementID id);
+    std::shared_ptr<ThreadPool> thread_pool_;
+    std::shared_ptr<FactoryMetrics> metrics_;
+    std::uint64_t random_seed_ = 0;
+    std::optional<std::uint64_t> routing_seed_;
+    bool node_index_stale_ = true;
+    std::vector<Worker*> worker_index_;
+    std::vector<IPackageReceiver*> receiver_index_;
+    std::unordered_map<const IPackageReceiver*, std::size_t> receiver_slots_;
+    std::vector<std::vector<Package>> staged_packages_;
+
+    void refresh_node_index();
+
+    void seed_node(Ramp& ramp);
+    void seed_node(Worker& worker);
+
+    void attach_metrics(Ramp& ramp);
+    void attach_metrics(Worker& worker);
+    void attach_metrics(Storehouse& storehouse);
+    void release_metrics(MetricsNodeKind kind, ElementID id) { if (metrics_) { metrics_->release_node(kind, id); } }
+
+    ConsistencyReport check_consistency(const std::unordered_set<const PackageSender*>& excluded) const;
+    PackageSender* find_sender(NodeRef node);
+    IPackageReceiver* find_receiver(NodeRef node);
+    void remove_node(NodeRef node);
 };
 
-Factory load_factory_structure(std::istream& input_stream);;
-void save_factory_structure(Factory& factory, std::ostream& output_stream);
+Factory load_factory_structure(std::istream& input_stream, std::shared_ptr<FactoryMemory> memory = nullptr);
+void save_factory_structure(const Factory& factory, std::ostream& output_stream);
 
 #endif //FACTORY_HPP
\ No newline at end of file
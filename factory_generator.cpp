@@ -0,0 +1,202 @@
+#include "factory_generator.hpp"
+#include "output_buffer.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string_view>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::uint64_t GENERATOR_STREAM = std::uint64_t(5) << 32;
+
+class StructureGenerator {
+public:
+    StructureGenerator(const FactoryShapeOptions& options, OutputBuffer& out) : options_(options), out_(out), rng_(options.seed, GENERATOR_STREAM) {}
+
+    void generate() {
+        write_nodes();
+        switch (options_.shape) {
+            case FactoryShape::LAYERED:
+                write_layered_links();
+                break;
+            case FactoryShape::FAN_OUT:
+                write_fan_out_links();
+                break;
+            case FactoryShape::CHAIN:
+                write_chain_links();
+                break;
+            case FactoryShape::RANDOM_GRAPH:
+                write_random_links();
+                break;
+        }
+        out_.flush();
+    }
+
+private:
+    void write_time(const TimeDistribution& time) {
+        if (time.is_fixed()) {
+            out_.put_number(time.get_value());
+        } else {
+            out_.put(time.to_string());
+        }
+    }
+
+    void write_nodes() {
+        for (std::size_t r = 1; r <= options_.ramps; ++r) {
+            out_.put("LOADING_RAMP id=");
+            out_.put_number(r);
+            out_.put(" delivery-interval=");
+            write_time(options_.delivery_interval);
+            out_.put("\n");
+        }
+        for (std::size_t w = 1; w <= options_.workers; ++w) {
+            out_.put("WORKER id=");
+            out_.put_number(w);
+            out_.put(" processing-time=");
+            write_time(options_.processing_time);
+            out_.put(options_.queue_type == PackageQueueType::FIFO ? std::string_view(" queue-type=FIFO") : std::string_view(" queue-type=LIFO"));
+            if (options_.worker_capacity) {
+                out_.put(" capacity=");
+                out_.put_number(options_.worker_capacity);
+            }
+            out_.put("\n");
+        }
+        for (std::size_t s = 1; s <= options_.storehouses; ++s) {
+            out_.put("STOREHOUSE id=");
+            out_.put_number(s);
+            out_.put("\n");
+        }
+    }
+
+    // Nodes are indexed from 0 here and written with IDs from 1.
+    void link(std::string_view sender, std::size_t sender_index, std::string_view receiver, std::size_t receiver_index) {
+        out_.put("LINK src=");
+        out_.put(sender);
+        out_.put_number(sender_index + 1);
+        out_.put(" dest=");
+        out_.put(receiver);
+        out_.put_number(receiver_index + 1);
+        out_.put("\n");
+    }
+
+    // fan_out distinct receivers among count ones starting at first, from a random offset.
+    void link_to_range(std::string_view sender, std::size_t sender_index, std::string_view receiver, std::size_t first, std::size_t count) {
+        std::size_t offset = draw(count);
+        for (std::size_t k = 0; k < std::min(options_.fan_out, count); ++k) {
+            link(sender, sender_index, receiver, first + (offset + k) % count);
+        }
+    }
+
+    std::size_t draw(std::size_t n) { return std::min(n - 1, static_cast<std::size_t>(rng_() * static_cast<double>(n))); }
+
+    std::size_t layer_begin(std::size_t layer, std::size_t layers) const { return options_.workers * layer / layers; }
+
+    void write_layered_links() {
+        std::size_t layers = std::min(options_.depth, options_.workers);
+        for (std::size_t r = 0; r < options_.ramps; ++r) {
+            link_to_range("ramp-", r, "worker-", 0, layer_begin(1, layers));
+        }
+        for (std::size_t layer = 0; layer < layers; ++layer) {
+            std::size_t next = layer_begin(layer + 1, layers);
+            for (std::size_t w = layer_begin(layer, layers); w < next; ++w) {
+                if (layer + 1 < layers) {
+                    link_to_range("worker-", w, "worker-", next, layer_begin(layer + 2, layers) - next);
+                } else {
+                    link_to_range("worker-", w, "store-", 0, options_.storehouses);
+                }
+            }
+        }
+    }
+
+    void write_fan_out_links() {
+        // With more ramps than workers the extra ramps share the slices of the first ones.
+        std::size_t slices = std::min(options_.ramps, options_.workers);
+        for (std::size_t r = 0; r < options_.ramps; ++r) {
+            std::size_t slice = r % slices;
+            for (std::size_t w = options_.workers * slice / slices; w < options_.workers * (slice + 1) / slices; ++w) {
+                link("ramp-", r, "worker-", w);
+            }
+        }
+        for (std::size_t w = 0; w < options_.workers; ++w) {
+            link("worker-", w, "store-", w % options_.storehouses);
+        }
+    }
+
+    void write_chain_links() {
+        std::size_t chains = std::max<std::size_t>(1, options_.workers / options_.depth);
+        auto chain_begin = [this, chains](std::size_t chain) { return options_.workers * chain / chains; };
+        for (std::size_t r = 0; r < std::max(options_.ramps, chains); ++r) {
+            link("ramp-", r % options_.ramps, "worker-", chain_begin(r % chains));
+        }
+        for (std::size_t chain = 0; chain < chains; ++chain) {
+            std::size_t last = chain_begin(chain + 1) - 1;
+            for (std::size_t w = chain_begin(chain); w < last; ++w) {
+                link("worker-", w, "worker-", w + 1);
+            }
+            link("worker-", last, "store-", chain % options_.storehouses);
+        }
+    }
+
+    // Forward links alone reach a storehouse from every worker (the last ones link to one directly),
+    // so the back links only add cycles.
+    void write_random_links() {
+        for (std::size_t r = 0; r < options_.ramps; ++r) {
+            link_to_range("ramp-", r, "worker-", 0, options_.workers);
+        }
+        for (std::size_t w = 0; w < options_.workers; ++w) {
+            std::size_t later = options_.workers - w - 1;
+            if (later > 0) {
+                link_to_range("worker-", w, "worker-", w + 1, later);
+            }
+            if (later < options_.fan_out) {
+                link("worker-", w, "store-", draw(options_.storehouses));
+            }
+            if (w > 0 && rng_() < options_.cycle_probability) {
+                link("worker-", w, "worker-", draw(w));
+            }
+        }
+    }
+
+    const FactoryShapeOptions& options_;
+    OutputBuffer& out_;
+    CounterRng rng_;
+};
+
+
+void generate(const FactoryShapeOptions& options, OutputBuffer& out) {
+    if (options.ramps == 0 || options.workers == 0 || options.storehouses == 0) {
+        throw std::invalid_argument("Generowana sieć musi mieć co najmniej jedną rampę, jednego robotnika i jeden magazyn");
+    }
+    if (options.depth == 0 || options.fan_out == 0) {
+        throw std::invalid_argument("Głębokość i liczba odbiorców generowanej sieci muszą być dodatnie");
+    }
+    StructureGenerator(options, out).generate();
+}
+
+}
+
+
+void generate_factory_structure(const FactoryShapeOptions& options, std::ostream& output_stream) {
+    OutputBuffer out(output_stream);
+    generate(options, out);
+    output_stream.flush();
+}
+
+
+void generate_factory_structure_file(const FactoryShapeOptions& options, const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Nie można otworzyć pliku " + path);
+    }
+    try {
+        OutputBuffer out(fd);
+        generate(options, out);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    if (::close(fd) != 0) {
+        throw std::runtime_error("Nie udało się zapisać pliku " + path);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef FACTORY_GENERATOR_HPP
+#define FACTORY_GENERATOR_HPP
+
+#include "distributions.hpp"
+#include "storage_types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+enum class FactoryShape {
+    // workers in `depth` layers, every sender linked to fan_out nodes of the next layer
+    LAYERED,
+    // every ramp feeds its own slice of the workers, each worker sends to one storehouse
+    FAN_OUT,
+    // chains of `depth` workers, each fed by a ramp and ending in a storehouse
+    CHAIN,
+    // every worker linked to fan_out later workers and, with cycle_probability, back to an earlier one
+    RANDOM_GRAPH
+};
+
+
+struct FactoryShapeOptions {
+    FactoryShape shape = FactoryShape::LAYERED;
+    std::size_t ramps = 4;
+    std::size_t workers = 64;
+    std::size_t storehouses = 4;
+    std::size_t depth = 4;
+    std::size_t fan_out = 2;
+    double cycle_probability = 0.1;
+    TimeDistribution delivery_interval = 1;
+    TimeDistribution processing_time = 1;
+    PackageQueueType queue_type = PackageQueueType::FIFO;
+    // capacity of every worker's queue, 0 for unbounded queues
+    std::size_t worker_capacity = 0;
+    std::uint64_t seed = 1;
+};
+
+
+// Writes a consistent structure of the given shape in the structure format, streaming it line by
+// line, so structures of millions of nodes take no more memory than a small one. The same options
+// always give the same structure.
+void generate_factory_structure(const FactoryShapeOptions& options, std::ostream& output_stream);
+void generate_factory_structure_file(const FactoryShapeOptions& options, const std::string& path);
+
+#endif //FACTORY_GENERATOR_HPP
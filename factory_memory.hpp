@@ -0,0 +1,27 @@
+#ifndef FACTORY_MEMORY_HPP
+#define FACTORY_MEMORY_HPP
+
+#include <cstddef>
+#include <memory_resource>
+
+// Memory of one factory. Node chunks come from a monotonic arena, which never frees
+// until the factory is gone and then releases everything at once. Queue and stockpile
+// storage comes from a pool of size classes on top of the arena. The pool is
+// synchronized because workers on a thread pool grow their queues concurrently.
+// Blocks too large for the pool go straight to the arena, so a queue that keeps
+// doubling leaves its old buffers there; that costs at most twice its final size.
+class FactoryMemory {
+public:
+    FactoryMemory(std::size_t initial_size = 1 << 16) : arena_(initial_size), pool_(&arena_) {}
+    FactoryMemory(const FactoryMemory&) = delete;
+    FactoryMemory& operator=(const FactoryMemory&) = delete;
+
+    std::pmr::memory_resource* get_structure_resource() { return &arena_; }
+    std::pmr::memory_resource* get_package_resource() { return &pool_; }
+
+private:
+    std::pmr::monotonic_buffer_resource arena_;
+    std::pmr::synchronized_pool_resource pool_;
+};
+
+#endif //FACTORY_MEMORY_HPP
@@ -0,0 +1,210 @@
+#include "flat_factory.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+FlatStructure::FlatStructure(const Factory& factory) {
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> receiver_index;
+    std::vector<const PackageSender*> senders;
+
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        if (it->get_servers() > 1) {
+            throw std::logic_error("Robotnik o ID " + std::to_string(it->get_id()) + " ma wiele stanowisk, czego płaska fabryka nie obsługuje");
+        }
+        receiver_index[&*it] = static_cast<std::uint32_t>(worker_count++);
+        senders.push_back(&*it);
+        worker_ids.push_back(it->get_id());
+        processing_time.push_back(it->get_duration_sampler());
+        lifo.push_back(it->get_queue()->get_queue_type() == PackageQueueType::LIFO);
+        capacity.push_back(it->get_capacity());
+    }
+
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        receiver_index[&*it] = static_cast<std::uint32_t>(worker_count + storehouse_count++);
+        storehouse_ids.push_back(it->get_id());
+        capacity.push_back(it->get_capacity());
+    }
+
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        ++ramp_count;
+        senders.push_back(&*it);
+        ramp_ids.push_back(it->get_id());
+        delivery_interval.push_back(it->get_duration_sampler());
+    }
+
+    route_offsets.push_back(0);
+    for (const PackageSender* sender : senders) {
+        double cumulative_probability = 0.0;
+        for (const auto& [receiver, probability] : sender->receiver_preferences_.get_preferences()) {
+            cumulative_probability += probability;
+            route_cumulative.push_back(cumulative_probability);
+            route_targets.push_back(receiver_index.at(receiver));
+        }
+        // as in ReceiverPreferences::rebuild_sampling_table
+        if (route_targets.size() > route_offsets.back()) {
+            route_cumulative.back() = 1.0;
+        }
+        route_offsets.push_back(route_targets.size());
+    }
+}
+
+
+std::uint32_t FlatStructure::choose_receiver(std::size_t sender, double prob) const {
+    auto first = route_cumulative.begin() + static_cast<std::ptrdiff_t>(route_offsets[sender]);
+    auto last = route_cumulative.begin() + static_cast<std::ptrdiff_t>(route_offsets[sender + 1]);
+    auto it = std::lower_bound(first, last, prob);
+    return it == last ? NO_RECEIVER : route_targets[it - route_cumulative.begin()];
+}
+
+
+FlatFactory::FlatFactory(Factory& factory)
+    : structure_(std::make_shared<FlatStructure>(factory)), state_(*structure_, PackageIDAllocator::NO_ID), stored_packages_(structure_->storehouse_count) {
+    std::size_t w = 0;
+    for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it, ++w) {
+        Worker& worker = *it;
+        state_.start_time[w] = worker.get_package_processing_start_time();
+        if (worker.get_processing_buffer()) {
+            state_.finish_time[w] = worker.get_next_completion();
+        }
+        std::optional<Package> processing = worker.take_processing_buffer();
+        state_.processing[w] = processing ? processing->detach() : PackageIDAllocator::NO_ID;
+
+        IPackageQueue* queue = worker.get_queue();
+        std::vector<ElementID> queued;
+        while (!queue->empty()) {
+            queued.push_back(queue->pop().detach());
+        }
+        if (structure_->lifo[w]) {
+            std::reverse(queued.begin(), queued.end());
+        }
+        for (ElementID package : queued) {
+            state_.push_to_queue(w, package);
+        }
+    }
+    std::size_t r = 0;
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it, ++r) {
+        state_.next_delivery[r] = it->get_drawn_next_delivery();
+    }
+    std::size_t s = 0;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it, ++s) {
+        state_.stock[s] = it->get_stockpile()->size();
+    }
+
+    std::size_t sender = 0;
+    auto take_sender_state = [this, &sender](PackageSender& node) {
+        std::optional<Package> sending = node.take_sending_buffer();
+        state_.sending[sender++] = sending ? sending->detach() : PackageIDAllocator::NO_ID;
+        streams_.push_back(node.receiver_preferences_.get_stream());
+        generators_.push_back(node.receiver_preferences_.get_probability_generator());
+    };
+    for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+        take_sender_state(*it);
+    }
+    for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+        take_sender_state(*it);
+    }
+}
+
+
+FlatFactory::~FlatFactory() {
+    PackageIDAllocator& allocator = Package::get_id_allocator();
+    for (ElementID package : state_.processing) {
+        allocator.release(package);
+    }
+    for (ElementID package : state_.sending) {
+        allocator.release(package);
+    }
+    for (std::size_t w = 0; w < structure_->worker_count; ++w) {
+        while (state_.queue_size[w]) {
+            allocator.release(state_.pop_from_queue(w));
+        }
+    }
+    for (const auto& stored : stored_packages_) {
+        for (ElementID package : stored) {
+            allocator.release(package);
+        }
+    }
+}
+
+
+void FlatFactory::do_deliveries(Time t) {
+    PackageIDAllocator& allocator = Package::get_id_allocator();
+    state_.do_deliveries(t, [&allocator](Time) { return allocator.acquire(); });
+}
+
+
+void FlatFactory::do_package_passing() {
+    state_.do_package_passing([this](std::size_t sender) { return streams_[sender] ? (*streams_[sender])() : generators_[sender](); },
+                              [this](std::size_t storehouse, ElementID package) { stored_packages_[storehouse].push_back(package); });
+}
+
+
+void FlatFactory::do_work(Time t) {
+    state_.do_work(t);
+}
+
+
+void FlatFactory::store(Factory& factory) {
+    auto adopt = [](ElementID& package) -> std::optional<Package> {
+        if (package == PackageIDAllocator::NO_ID) {
+            return std::nullopt;
+        }
+        return Package(std::exchange(package, PackageIDAllocator::NO_ID));
+    };
+
+    std::size_t w = 0;
+    for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it, ++w) {
+        if (w >= structure_->worker_count) {
+            throw std::logic_error("Struktura fabryki zmieniła się od kompilacji");
+        }
+        std::optional<Package> processing = adopt(state_.processing[w]);
+        if (processing) {
+            it->restore_processing_buffer(std::move(*processing), state_.start_time[w], state_.finish_time[w]);
+        } else {
+            it->restore_processing_buffer(std::nullopt, state_.start_time[w]);
+        }
+        it->set_duration_position(state_.processing_time[w].get_position());
+        it->receiver_preferences_.set_stream_counter(streams_[w] ? streams_[w]->get_counter() : 0);
+        it->restore_sending_buffer(adopt(state_.sending[w]));
+
+        IPackageQueue* queue = it->get_queue();
+        for (std::size_t i = 0; i < state_.queue_size[w]; ++i) {
+            queue->push(Package(state_.queued(w, i)));
+        }
+        state_.queue_size[w] = 0;
+        state_.queue_head[w] = 0;
+    }
+
+    std::size_t r = 0;
+    for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it, ++r) {
+        it->restore_durations(state_.next_delivery[r], state_.delivery_interval[r].get_position());
+        std::size_t sender = structure_->worker_count + r;
+        it->receiver_preferences_.set_stream_counter(streams_[sender] ? streams_[sender]->get_counter() : 0);
+        it->restore_sending_buffer(adopt(state_.sending[structure_->worker_count + r]));
+    }
+
+    std::size_t s = 0;
+    for (auto it = factory.storehouse_begin(); it != factory.storehouse_end(); ++it, ++s) {
+        for (ElementID package : stored_packages_[s]) {
+            it->receive_package(Package(package));
+        }
+        stored_packages_[s].clear();
+    }
+}
+
+
+void simulate_flat(Factory& factory, TimeOffset d) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Sieć jest niespójna");
+    }
+
+    FlatFactory flat(factory);
+    for (Time t = 1; t <= d; ++t) {
+        flat.do_deliveries(t);
+        flat.do_package_passing();
+        flat.do_work(t);
+    }
+    flat.store(factory);
+}
@@ -0,0 +1,238 @@
+#ifndef FLAT_FACTORY_HPP
+#define FLAT_FACTORY_HPP
+
+#include "distributions.hpp"
+#include "factory.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Immutable part of a flat factory: dense indices, durations and routing tables. Workers come
+// first among both senders (then ramps) and receivers (then storehouses), in the order Factory
+// visits them. It can be shared by any number of simulations of the same structure.
+// Workers with more than one server are not supported.
+struct FlatStructure {
+    static constexpr std::uint32_t NO_RECEIVER = static_cast<std::uint32_t>(-1);
+
+    FlatStructure(const Factory& factory);
+
+    std::uint32_t choose_receiver(std::size_t sender, double prob) const;
+    bool has_room(std::uint32_t receiver, std::size_t size) const { return capacity[receiver] == 0 || size < capacity[receiver]; }
+
+    std::size_t worker_count = 0;
+    std::size_t ramp_count = 0;
+    std::size_t storehouse_count = 0;
+
+    std::vector<ElementID> worker_ids;
+    // samplers as the nodes had them, each on the node's own stream
+    std::vector<DurationSampler> processing_time;
+    std::vector<std::uint8_t> lifo;
+
+    std::vector<ElementID> ramp_ids;
+    std::vector<DurationSampler> delivery_interval;
+
+    std::vector<ElementID> storehouse_ids;
+
+    // per receiver, 0 when unbounded
+    std::vector<std::size_t> capacity;
+
+    std::vector<std::size_t> route_offsets;
+    std::vector<double> route_cumulative;
+    std::vector<std::uint32_t> route_targets;
+};
+
+
+// Mutable state of a flat simulation and the phases of a turn, shared by FlatFactory (a package is
+// its ID) and the replicas of run_ensemble (a package is the turn it left a ramp). Senders,
+// workers and storehouses are indexed as in FlatStructure; a slot equal to `empty` holds no package.
+template<typename Slot>
+struct FlatTurnState {
+    FlatTurnState(const FlatStructure& structure, Slot empty);
+
+    // make_package(t) gives the package delivered in turn t.
+    template<typename MakePackage>
+    void do_deliveries(Time t, MakePackage&& make_package);
+    // draw(s) gives the routing draw of sender s; store(s, package) is told of every package
+    // storehouse s receives.
+    template<typename Draw, typename Store>
+    void do_package_passing(Draw&& draw, Store&& store);
+    void do_work(Time t);
+
+    void push_to_queue(std::size_t worker, Slot package);
+    Slot pop_from_queue(std::size_t worker);
+    // The i-th package from the head of the ring, i.e. in the order the packages were queued.
+    Slot queued(std::size_t worker, std::size_t i) const { return queue_storage[worker][(queue_head[worker] + i) & (queue_storage[worker].size() - 1)]; }
+
+    const FlatStructure& structure;
+    Slot empty;
+
+    // workers
+    std::vector<Time> start_time;
+    std::vector<Time> finish_time;
+    std::vector<DurationSampler> processing_time;
+    std::vector<Slot> processing;
+    std::vector<std::size_t> queue_head;
+    std::vector<std::size_t> queue_size;
+    std::vector<std::vector<Slot>> queue_storage;
+
+    // ramps; the next delivery turn is used with drawn intervals only
+    std::vector<DurationSampler> delivery_interval;
+    std::vector<Time> next_delivery;
+
+    // senders
+    std::vector<Slot> sending;
+
+    // packages in every storehouse
+    std::vector<std::size_t> stock;
+};
+
+
+// Structure-of-arrays form of a Factory for running many turns. The hot fields live in
+// parallel arrays indexed as in FlatStructure; packages are plain IDs owned by the FlatFactory.
+// Constructing one moves the mutable state (buffers and queues) out of the factory, store()
+// moves it back; the structure of the factory must not change in between.
+class FlatFactory {
+public:
+    FlatFactory(Factory& factory);
+    FlatFactory(const FlatFactory&) = delete;
+    FlatFactory& operator=(const FlatFactory&) = delete;
+
+    void do_deliveries(Time t);
+    void do_package_passing();
+    void do_work(Time t);
+
+    void store(Factory& factory);
+
+    const std::shared_ptr<const FlatStructure>& get_structure() const { return structure_; }
+
+    ~FlatFactory();
+
+private:
+    std::shared_ptr<const FlatStructure> structure_;
+    FlatTurnState<ElementID> state_;
+    // per sender, its routing stream (see Factory::set_routing_seed) or else its probability generator
+    std::vector<std::optional<CounterRng>> streams_;
+    std::vector<ProbabilityGenerator> generators_;
+
+    // per storehouse, packages stored since construction
+    std::vector<std::vector<ElementID>> stored_packages_;
+};
+
+
+void simulate_flat(Factory& factory, TimeOffset d);
+
+
+template<typename Slot>
+FlatTurnState<Slot>::FlatTurnState(const FlatStructure& structure, Slot empty)
+    : structure(structure), empty(empty), start_time(structure.worker_count, 0), finish_time(structure.worker_count, 0),
+      processing_time(structure.processing_time), processing(structure.worker_count, empty), queue_head(structure.worker_count, 0),
+      queue_size(structure.worker_count, 0), queue_storage(structure.worker_count), delivery_interval(structure.delivery_interval),
+      next_delivery(structure.ramp_count, 1), sending(structure.worker_count + structure.ramp_count, empty), stock(structure.storehouse_count, 0) {}
+
+
+template<typename Slot>
+template<typename MakePackage>
+void FlatTurnState<Slot>::do_deliveries(Time t, MakePackage&& make_package) {
+    // as Ramp::deliver_goods
+    for (std::size_t r = 0; r < structure.ramp_count; ++r) {
+        DurationSampler& interval = delivery_interval[r];
+        if (interval.get_distribution().is_fixed()) {
+            if ((t - 1) % interval.get_distribution().get_value() != 0) {
+                continue;
+            }
+        } else {
+            if (next_delivery[r] > t) {
+                continue;
+            }
+            next_delivery[r] = t + std::max<TimeOffset>(interval.next(), 1);
+        }
+        Slot& buffer = sending[structure.worker_count + r];
+        if (buffer == empty) {
+            buffer = make_package(t);
+        }
+    }
+}
+
+
+template<typename Slot>
+template<typename Draw, typename Store>
+void FlatTurnState<Slot>::do_package_passing(Draw&& draw, Store&& store) {
+    for (std::size_t s = 0; s < sending.size(); ++s) {
+        if (sending[s] == empty) {
+            continue;
+        }
+        std::uint32_t receiver = structure.choose_receiver(s, draw(s));
+        if (receiver == FlatStructure::NO_RECEIVER) {
+            continue;
+        }
+        if (receiver < structure.worker_count) {
+            if (!structure.has_room(receiver, queue_size[receiver])) {
+                continue;
+            }
+            push_to_queue(receiver, sending[s]);
+        } else {
+            std::size_t storehouse = receiver - structure.worker_count;
+            if (!structure.has_room(receiver, stock[storehouse])) {
+                continue;
+            }
+            ++stock[storehouse];
+            store(storehouse, sending[s]);
+        }
+        sending[s] = empty;
+    }
+}
+
+
+template<typename Slot>
+void FlatTurnState<Slot>::do_work(Time t) {
+    for (std::size_t w = 0; w < structure.worker_count; ++w) {
+        if (processing[w] == empty && queue_size[w]) {
+            processing[w] = pop_from_queue(w);
+            start_time[w] = t;
+            finish_time[w] = t + std::max<TimeOffset>(processing_time[w].next(), 1) - 1;
+        }
+    }
+
+    for (std::size_t w = 0; w < structure.worker_count; ++w) {
+        if (processing[w] != empty && sending[w] == empty && finish_time[w] <= t) {
+            sending[w] = processing[w];
+            processing[w] = empty;
+        }
+    }
+}
+
+
+template<typename Slot>
+void FlatTurnState<Slot>::push_to_queue(std::size_t worker, Slot package) {
+    std::vector<Slot>& ring = queue_storage[worker];
+    std::size_t size = queue_size[worker];
+    if (size == ring.size()) {
+        std::vector<Slot> grown(std::max<std::size_t>(8, 2 * ring.size()));
+        for (std::size_t i = 0; i < size; ++i) {
+            grown[i] = ring[(queue_head[worker] + i) & (ring.size() - 1)];
+        }
+        ring.swap(grown);
+        queue_head[worker] = 0;
+    }
+    ring[(queue_head[worker] + size) & (ring.size() - 1)] = package;
+    queue_size[worker] = size + 1;
+}
+
+
+template<typename Slot>
+Slot FlatTurnState<Slot>::pop_from_queue(std::size_t worker) {
+    std::vector<Slot>& ring = queue_storage[worker];
+    std::size_t mask = ring.size() - 1;
+    std::size_t size = --queue_size[worker];
+    if (structure.lifo[worker]) {
+        return ring[(queue_head[worker] + size) & mask];
+    }
+    Slot package = ring[queue_head[worker]];
+    queue_head[worker] = (queue_head[worker] + 1) & mask;
+    return package;
+}
+
+#endif //FLAT_FACTORY_HPP
@@ -0,0 +1,282 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+
+std::size_t LatencyHistogram::bucket_of(std::uint64_t value) {
+    if (value < SUB_COUNT) {
+        return static_cast<std::size_t>(value);
+    }
+    auto exponent = static_cast<unsigned>(63 - __builtin_clzll(value));
+    std::uint64_t sub = (value >> (exponent - SUB_BITS)) - SUB_COUNT;
+    return static_cast<std::size_t>((exponent - SUB_BITS + 1) * SUB_COUNT + sub);
+}
+
+
+std::uint64_t LatencyHistogram::bucket_upper(std::size_t bucket) {
+    if (bucket < SUB_COUNT) {
+        return bucket;
+    }
+    std::uint64_t group = bucket / SUB_COUNT;
+    std::uint64_t sub = bucket % SUB_COUNT;
+    std::uint64_t lower = (SUB_COUNT + sub) << (group - 1);
+    return lower + (std::uint64_t(1) << (group - 1)) - 1;
+}
+
+
+void LatencyHistogram::record(std::uint64_t value) {
+    std::size_t bucket = bucket_of(value);
+    if (bucket >= buckets_.size()) {
+        buckets_.resize(bucket + 1, 0);
+    }
+    ++buckets_[bucket];
+    ++count_;
+    sum_ += value;
+    max_ = std::max(max_, value);
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.buckets_.size() > buckets_.size()) {
+        buckets_.resize(other.buckets_.size(), 0);
+    }
+    for (std::size_t i = 0; i < other.buckets_.size(); ++i) {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
+
+
+std::uint64_t LatencyHistogram::percentile(double fraction) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(fraction * static_cast<double>(count_))));
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < buckets_.size(); ++bucket) {
+        seen += buckets_[bucket];
+        if (seen >= rank) {
+            return std::min(bucket_upper(bucket), max_);
+        }
+    }
+    return max_;
+}
+
+
+std::uint32_t FactoryMetrics::add_node(MetricsNodeKind kind, ElementID id, std::size_t queue_depth, std::size_t servers) {
+    auto [found, inserted] = slot_of_node_.try_emplace(node_key(kind, id), 0);
+    if (!inserted) {
+        // Re-registered (set_metrics again): the queue may have changed while it was detached.
+        NodeCounters& counters = counters_[found->second];
+        track_depth(counters);
+        counters.queue_depth = queue_depth;
+        counters.max_queue_depth = std::max<std::uint64_t>(counters.max_queue_depth, queue_depth);
+        servers_[found->second] = servers;
+        return found->second;
+    }
+
+    std::uint32_t slot;
+    if (free_slots_.empty()) {
+        slot = static_cast<std::uint32_t>(counters_.size());
+        counters_.emplace_back();
+        kinds_.push_back(kind);
+        ids_.push_back(id);
+        servers_.push_back(servers);
+        sojourn_.emplace_back();
+        active_.push_back(1);
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        counters_[slot] = NodeCounters();
+        kinds_[slot] = kind;
+        ids_[slot] = id;
+        servers_[slot] = servers;
+        sojourn_[slot] = LatencyHistogram();
+        active_[slot] = 1;
+    }
+    counters_[slot].queue_depth = queue_depth;
+    counters_[slot].max_queue_depth = queue_depth;
+    counters_[slot].queue_depth_since = turn_;
+    found->second = slot;
+    return slot;
+}
+
+
+void FactoryMetrics::release_node(MetricsNodeKind kind, ElementID id) {
+    auto found = slot_of_node_.find(node_key(kind, id));
+    if (found == slot_of_node_.end()) {
+        return;
+    }
+    active_[found->second] = 0;
+    free_slots_.push_back(found->second);
+    slot_of_node_.erase(found);
+}
+
+
+void FactoryMetrics::begin_turn(Time t) {
+    if (first_turn_ == UNKNOWN_TURN) {
+        first_turn_ = t;
+        for (auto& counters : counters_) {
+            counters.queue_depth_since = t;
+        }
+    }
+    turn_ = t;
+}
+
+
+void FactoryMetrics::track_depth(NodeCounters& counters) {
+    counters.queue_depth_area += counters.queue_depth * static_cast<std::uint64_t>(turn_ - counters.queue_depth_since);
+    counters.queue_depth_since = turn_;
+}
+
+
+void FactoryMetrics::on_delivered(std::uint32_t slot, ElementID package) {
+    ++counters_[slot].delivered;
+    auto index = static_cast<std::size_t>(package);
+    if (index >= birth_turn_.size()) {
+        // Only deliveries run serially, so this is the one place the tables may grow.
+        std::size_t size = std::max<std::size_t>(index + 1, 2 * birth_turn_.size());
+        birth_turn_.resize(size, UNKNOWN_TURN);
+        enqueue_turn_.resize(size, UNKNOWN_TURN);
+    }
+    birth_turn_[index] = turn_;
+}
+
+
+void FactoryMetrics::on_enqueued(std::uint32_t slot, ElementID package) {
+    NodeCounters& counters = counters_[slot];
+    ++counters.received;
+    track_depth(counters);
+    counters.max_queue_depth = std::max(counters.max_queue_depth, ++counters.queue_depth);
+
+    auto index = static_cast<std::size_t>(package);
+    if (index < enqueue_turn_.size()) {
+        enqueue_turn_[index] = turn_;
+    }
+}
+
+
+void FactoryMetrics::on_dequeued(std::uint32_t slot, ElementID package) {
+    NodeCounters& counters = counters_[slot];
+    track_depth(counters);
+    if (counters.queue_depth) {
+        --counters.queue_depth;
+    }
+
+    auto index = static_cast<std::size_t>(package);
+    if (index < enqueue_turn_.size() && enqueue_turn_[index] != UNKNOWN_TURN) {
+        counters.queue_wait_turns += static_cast<std::uint64_t>(turn_ - enqueue_turn_[index]);
+        enqueue_turn_[index] = UNKNOWN_TURN;
+    }
+}
+
+
+void FactoryMetrics::on_processed(std::uint32_t slot, TimeOffset duration) {
+    ++counters_[slot].processed;
+    counters_[slot].busy_turns += static_cast<std::uint64_t>(duration);
+}
+
+
+void FactoryMetrics::on_stored(std::uint32_t slot, ElementID package) {
+    ++counters_[slot].received;
+
+    auto index = static_cast<std::size_t>(package);
+    if (index < birth_turn_.size() && birth_turn_[index] != UNKNOWN_TURN) {
+        sojourn_[slot].record(static_cast<std::uint64_t>(turn_ - birth_turn_[index]));
+        birth_turn_[index] = UNKNOWN_TURN;
+    }
+}
+
+
+double FactoryMetrics::get_mean_queue_depth(std::uint32_t slot) const {
+    Time turns = get_observed_turns();
+    if (turns <= 0) {
+        return 0.0;
+    }
+    const NodeCounters& counters = counters_[slot];
+    std::uint64_t area = counters.queue_depth_area + counters.queue_depth * static_cast<std::uint64_t>(turn_ + 1 - counters.queue_depth_since);
+    return static_cast<double>(area) / static_cast<double>(turns);
+}
+
+
+namespace {
+
+const char* kind_name(MetricsNodeKind kind) {
+    switch (kind) {
+        case MetricsNodeKind::RAMP:
+            return "ramp";
+        case MetricsNodeKind::WORKER:
+            return "worker";
+        case MetricsNodeKind::STOREHOUSE:
+            return "store";
+    }
+    return "";
+}
+
+struct NodeSummary {
+    const NodeCounters& counters;
+    const LatencyHistogram& sojourn;
+    double utilization;
+    double mean_queue_depth;
+    double mean_queue_wait;
+};
+
+NodeSummary summarize(const FactoryMetrics& metrics, std::uint32_t slot) {
+    const NodeCounters& counters = metrics.get_counters(slot);
+    Time turns = metrics.get_observed_turns();
+    // busy turns of all servers over the turns they could have worked
+    double capacity = static_cast<double>(turns) * static_cast<double>(metrics.get_servers(slot));
+    return {counters, metrics.get_sojourn(slot),
+            turns > 0 ? static_cast<double>(counters.busy_turns) / capacity : 0.0,
+            metrics.get_mean_queue_depth(slot),
+            counters.processed ? static_cast<double>(counters.queue_wait_turns) / static_cast<double>(counters.processed) : 0.0};
+}
+
+}
+
+
+void write_metrics_csv(const FactoryMetrics& metrics, std::ostream& output_stream) {
+    output_stream << "node,id,delivered,received,sent,blocked_sends,processed,busy_turns,utilization,"
+                     "mean_queue_depth,max_queue_depth,mean_queue_wait,sojourn_count,sojourn_mean,"
+                     "sojourn_p50,sojourn_p90,sojourn_p99,sojourn_max\n";
+    for (std::uint32_t slot = 0; slot < metrics.size(); ++slot) {
+        if (!metrics.is_active(slot)) {
+            continue;
+        }
+        NodeSummary node = summarize(metrics, slot);
+        output_stream << kind_name(metrics.get_kind(slot)) << ',' << metrics.get_id(slot) << ','
+                      << node.counters.delivered << ',' << node.counters.received << ',' << node.counters.sent << ','
+                      << node.counters.blocked_sends << ',' << node.counters.processed << ',' << node.counters.busy_turns << ','
+                      << node.utilization << ',' << node.mean_queue_depth << ',' << node.counters.max_queue_depth << ','
+                      << node.mean_queue_wait << ',' << node.sojourn.count() << ',' << node.sojourn.mean() << ','
+                      << node.sojourn.percentile(0.50) << ',' << node.sojourn.percentile(0.90) << ','
+                      << node.sojourn.percentile(0.99) << ',' << node.sojourn.max() << '\n';
+    }
+    output_stream.flush();
+}
+
+
+void write_metrics_json(const FactoryMetrics& metrics, std::ostream& output_stream) {
+    output_stream << "{\"turns\":" << metrics.get_observed_turns() << ",\"nodes\":[";
+    bool first = true;
+    for (std::uint32_t slot = 0; slot < metrics.size(); ++slot) {
+        if (!metrics.is_active(slot)) {
+            continue;
+        }
+        NodeSummary node = summarize(metrics, slot);
+        output_stream << (first ? "\n" : ",\n")
+                      << "{\"node\":\"" << kind_name(metrics.get_kind(slot)) << "\",\"id\":" << metrics.get_id(slot)
+                      << ",\"delivered\":" << node.counters.delivered << ",\"received\":" << node.counters.received
+                      << ",\"sent\":" << node.counters.sent << ",\"blocked_sends\":" << node.counters.blocked_sends
+                      << ",\"processed\":" << node.counters.processed << ",\"busy_turns\":" << node.counters.busy_turns
+                      << ",\"utilization\":" << node.utilization << ",\"mean_queue_depth\":" << node.mean_queue_depth
+                      << ",\"max_queue_depth\":" << node.counters.max_queue_depth << ",\"mean_queue_wait\":" << node.mean_queue_wait
+                      << ",\"sojourn\":{\"count\":" << node.sojourn.count() << ",\"mean\":" << node.sojourn.mean()
+                      << ",\"p50\":" << node.sojourn.percentile(0.50) << ",\"p90\":" << node.sojourn.percentile(0.90)
+                      << ",\"p99\":" << node.sojourn.percentile(0.99) << ",\"max\":" << node.sojourn.max() << "}}";
+        first = false;
+    }
+    output_stream << "\n]}\n";
+    output_stream.flush();
+}
@@ -0,0 +1,151 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// Hooks are compiled in unless NETSIM_NO_METRICS is defined; at run time they cost one
+// null check per event until a FactoryMetrics is attached with Factory::set_metrics.
+
+enum class MetricsNodeKind : std::uint8_t {
+    RAMP, WORKER, STOREHOUSE
+};
+
+
+// Log-linear histogram in the style of HdrHistogram: values below 2^SUB_BITS are exact, every
+// higher power of two is split into 2^SUB_BITS buckets, so quantiles are within ~3% of the truth.
+class LatencyHistogram {
+public:
+    void record(std::uint64_t value);
+    void merge(const LatencyHistogram& other);
+
+    std::uint64_t count() const { return count_; }
+    std::uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0; }
+    std::uint64_t percentile(double fraction) const;
+
+private:
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr std::uint64_t SUB_COUNT = std::uint64_t(1) << SUB_BITS;
+
+    static std::size_t bucket_of(std::uint64_t value);
+    static std::uint64_t bucket_upper(std::size_t bucket);
+
+    std::vector<std::uint64_t> buckets_;
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t max_ = 0;
+};
+
+
+// One cache line (or two) per node, so workers running on different threads never share one.
+struct alignas(64) NodeCounters {
+    std::uint64_t delivered = 0;
+    std::uint64_t received = 0;
+    std::uint64_t sent = 0;
+    std::uint64_t blocked_sends = 0;
+    std::uint64_t processed = 0;
+    std::uint64_t busy_turns = 0;
+    std::uint64_t queue_wait_turns = 0;
+    std::uint64_t queue_depth = 0;
+    std::uint64_t max_queue_depth = 0;
+    // sum of the queue depth over turns, accumulated whenever the depth changes
+    std::uint64_t queue_depth_area = 0;
+    Time queue_depth_since = 0;
+};
+
+
+// Counters of every node plus ramp-to-storehouse sojourn histograms. Package birth and enqueue
+// turns are kept in tables indexed by package ID (IDs are dense), so packages carry nothing extra.
+// Nodes only touch their own slot and distinct packages, which is what the thread pool needs.
+class FactoryMetrics {
+public:
+    static constexpr Time UNKNOWN_TURN = std::numeric_limits<Time>::min();
+
+    // A node registered again keeps its slot and counters. Released slots are skipped by the
+    // exports and handed to the next node added, so removed nodes leave no rows behind.
+    std::uint32_t add_node(MetricsNodeKind kind, ElementID id, std::size_t queue_depth = 0, std::size_t servers = 1);
+    void release_node(MetricsNodeKind kind, ElementID id);
+
+    void begin_turn(Time t);
+    Time get_turn() const { return turn_; }
+
+    void on_delivered(std::uint32_t slot, ElementID package);
+    void on_sent(std::uint32_t slot) { ++counters_[slot].sent; }
+    void on_blocked(std::uint32_t slot) { ++counters_[slot].blocked_sends; }
+    void on_enqueued(std::uint32_t slot, ElementID package);
+    void on_dequeued(std::uint32_t slot, ElementID package);
+    void on_processed(std::uint32_t slot, TimeOffset duration);
+    void on_stored(std::uint32_t slot, ElementID package);
+
+    std::size_t size() const { return counters_.size(); }
+    bool is_active(std::uint32_t slot) const { return active_[slot] != 0; }
+    MetricsNodeKind get_kind(std::uint32_t slot) const { return kinds_[slot]; }
+    ElementID get_id(std::uint32_t slot) const { return ids_[slot]; }
+    std::size_t get_servers(std::uint32_t slot) const { return servers_[slot]; }
+    const NodeCounters& get_counters(std::uint32_t slot) const { return counters_[slot]; }
+    const LatencyHistogram& get_sojourn(std::uint32_t slot) const { return sojourn_[slot]; }
+    double get_mean_queue_depth(std::uint32_t slot) const;
+    Time get_observed_turns() const { return first_turn_ == UNKNOWN_TURN ? 0 : turn_ - first_turn_ + 1; }
+
+private:
+    static std::uint64_t node_key(MetricsNodeKind kind, ElementID id) { return (static_cast<std::uint64_t>(kind) << 32) | static_cast<std::uint32_t>(id); }
+
+    void track_depth(NodeCounters& counters);
+
+    std::vector<NodeCounters> counters_;
+    std::vector<MetricsNodeKind> kinds_;
+    std::vector<ElementID> ids_;
+    std::vector<std::size_t> servers_;
+    std::vector<LatencyHistogram> sojourn_;
+    std::vector<std::uint8_t> active_;
+    std::vector<std::uint32_t> free_slots_;
+    std::unordered_map<std::uint64_t, std::uint32_t> slot_of_node_;
+
+    std::vector<Time> birth_turn_;
+    std::vector<Time> enqueue_turn_;
+
+    Time turn_ = 0;
+    Time first_turn_ = UNKNOWN_TURN;
+};
+
+
+// What a node keeps to report to its FactoryMetrics; a no-op while detached.
+class MetricsHandle {
+public:
+    MetricsHandle() = default;
+    MetricsHandle(FactoryMetrics* metrics, std::uint32_t slot) : metrics_(metrics), slot_(slot) {}
+
+#ifndef NETSIM_NO_METRICS
+    void delivered(ElementID package) const { if (metrics_) { metrics_->on_delivered(slot_, package); } }
+    void sent() const { if (metrics_) { metrics_->on_sent(slot_); } }
+    void blocked() const { if (metrics_) { metrics_->on_blocked(slot_); } }
+    void enqueued(ElementID package) const { if (metrics_) { metrics_->on_enqueued(slot_, package); } }
+    void dequeued(ElementID package) const { if (metrics_) { metrics_->on_dequeued(slot_, package); } }
+    void processed(TimeOffset duration) const { if (metrics_) { metrics_->on_processed(slot_, duration); } }
+    void stored(ElementID package) const { if (metrics_) { metrics_->on_stored(slot_, package); } }
+#else
+    void delivered(ElementID) const {}
+    void sent() const {}
+    void blocked() const {}
+    void enqueued(ElementID) const {}
+    void dequeued(ElementID) const {}
+    void processed(TimeOffset) const {}
+    void stored(ElementID) const {}
+#endif
+
+private:
+    FactoryMetrics* metrics_ = nullptr;
+    std::uint32_t slot_ = 0;
+};
+
+
+void write_metrics_csv(const FactoryMetrics& metrics, std::ostream& output_stream);
+void write_metrics_json(const FactoryMetrics& metrics, std::ostream& output_stream);
+
+#endif //METRICS_HPP
@@ -0,0 +1,78 @@
+#include "checkpoint.hpp"
+#include "partition.hpp"
+#include "sharded_simulation.hpp"
+#include "structure_parser.hpp"
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Runs a structure file split into shards, each simulated by a process of its own (see simulate_sharded):
+//     netsim_sharded <structure file> <shards> [turns = 1000] [seed = 1] [checkpoint file]
+// The checkpoint file, if given, receives the state after the last turn.
+
+namespace {
+
+template<typename Number>
+Number parse_argument(const char* text, const char* name) {
+    Number value{};
+    auto [end, error] = std::from_chars(text, text + std::strlen(text), value);
+    if (error != std::errc() || *end != '\0') {
+        throw std::invalid_argument(std::string("Niepoprawny argument ") + name + ": " + text);
+    }
+    return value;
+}
+
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 6) {
+        std::cerr << "Użycie: " << argv[0] << " <plik struktury> <liczba fragmentów> [liczba tur] [ziarno] [plik stanu]\n";
+        return 2;
+    }
+    try {
+        auto shards = parse_argument<std::size_t>(argv[2], "liczba fragmentów");
+        auto turns = argc > 3 ? parse_argument<TimeOffset>(argv[3], "liczba tur") : 1000;
+        auto seed = argc > 4 ? parse_argument<std::uint64_t>(argv[4], "ziarno") : 1;
+        if (turns < 1) {
+            throw std::invalid_argument("Liczba tur musi być dodatnia");
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Factory factory = load_factory_structure_file(argv[1]);
+        factory.set_random_seed(seed);
+        factory.set_routing_seed(seed);
+        std::cout << "wczytanie: " << seconds_since(start) << " s\n";
+
+        start = std::chrono::steady_clock::now();
+        FactoryPartition partition = partition_factory(factory, shards);
+        std::cout << "podział na " << partition.shards << " fragmentów: " << seconds_since(start) << " s, przecięte połączenia: " << partition.cut_links << "\n";
+
+        start = std::chrono::steady_clock::now();
+        simulate_sharded(factory, turns, partition);
+        std::cout << "symulacja " << turns << " tur: " << seconds_since(start) << " s\n";
+
+        std::size_t stored = 0;
+        for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+            stored += it->get_stockpile()->size();
+        }
+        std::cout << "półproduktów w magazynach: " << stored << "\n";
+
+        if (argc > 5) {
+            save_checkpoint_file(factory, turns + 1, argv[5]);
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,76 +1,240 @@
 #include "nodes.hpp"
+#include <algorithm>
+#include <stdexcept>
 
 void PackageSender::push_package(Package&& package) {
-    ElementID package_id = package.get_id();
-    buff_ = package_id;
+    buff_.emplace(std::move(package));
 }
 
 
-void PackageSender::send_package() {
+IPackageReceiver *PackageSender::send_package() {
     if (buff_) {
-        IPackageReceiver *receiver = receiver_preferences_.choose_receiver();
-        if (receiver) {
+        const ReceiverHandle *receiver = receiver_preferences_.choose_receiver_handle();
+        if (receiver && receiver->has_room()) {
             receiver->receive_package(std::move(*buff_));
             buff_.reset();
+            metrics_.sent();
+            return receiver->get();
         }
+        metrics_.blocked();
+    }
+    return nullptr;
+}
+
+void IPackageReceiver::unlink_senders() {
+    for (ReceiverPreferences *preferences : senders_) {
+        preferences->drop_receiver(this);
+    }
+    senders_.clear();
+}
+
+void IPackageReceiver::remove_sender(ReceiverPreferences *preferences) {
+    auto it = std::find(senders_.begin(), senders_.end(), preferences);
+    if (it != senders_.end()) {
+        *it = senders_.back();
+        senders_.pop_back();
+    }
+}
+
+ReceiverPreferences::ReceiverPreferences(ReceiverPreferences &&other) noexcept
+    : prefs_(std::move(other.prefs_)), prefs_stale_(other.prefs_stale_), weights_(std::move(other.weights_)),
+      probability_generated_(std::move(other.probability_generated_)), stream_(other.stream_), sampling_table_stale_(true) {
+    other.prefs_.clear();
+    other.weights_.clear();
+    other.sampling_table_stale_ = true;
+    for (const auto &rec : weights_) {
+        std::replace(rec.first->senders_.begin(), rec.first->senders_.end(), &other, this);
     }
 }
 
-void ReceiverPreferences::add_receiver(IPackageReceiver *r) {
-    size_t num_of_receivers = prefs_.size();
-    double new_probability = 1.0 / (num_of_receivers + 1);
+ReceiverPreferences::~ReceiverPreferences() {
+    for (const auto &rec : weights_) {
+        rec.first->remove_sender(this);
+    }
+}
 
-    for (auto &rec : prefs_) {
-        rec.second = new_probability;
+void ReceiverPreferences::add_receiver(IPackageReceiver *r, double weight) {
+    if (!(weight > 0.0)) {
+        throw std::invalid_argument("Waga odbiorcy musi być dodatnia");
     }
-    prefs_[r] = new_probability;
+    if (weights_.insert_or_assign(r, weight).second) {
+        r->senders_.push_back(this);
+    }
+    prefs_stale_ = true;
+    sampling_table_stale_ = true;
 }
 
 void ReceiverPreferences::remove_receiver(IPackageReceiver *r) {
-    size_t num_of_receivers = prefs_.size();
-    prefs_.erase(r);
+    if (r && weights_.count(r)) {
+        r->remove_sender(this);
+        drop_receiver(r);
+    }
+}
 
-    if (num_of_receivers > 1) {
-        double new_probability = 1.0 / (num_of_receivers - 1);
-        for (auto &rec : prefs_) {
-            rec.second = new_probability;
-        }
+void ReceiverPreferences::drop_receiver(IPackageReceiver *r) {
+    if (weights_.erase(r)) {
+        prefs_stale_ = true;
+        sampling_table_stale_ = true;
     }
 }
 
-IPackageReceiver *ReceiverPreferences::choose_receiver() {
-    double prob = probability_generated_();
+void ReceiverPreferences::normalize() const {
+    double total_weight = 0.0;
+    for (const auto &rec : weights_) {
+        total_weight += rec.second;
+    }
+
+    prefs_.clear();
+    for (const auto &rec : weights_) {
+        prefs_.emplace_hint(prefs_.end(), rec.first, rec.second / total_weight);
+    }
+    prefs_stale_ = false;
+}
+
+void ReceiverPreferences::rebuild_sampling_table() {
+    cumulative_probabilities_.clear();
+    sampled_receivers_.clear();
+    const preferences_t &prefs = get_preferences();
+    cumulative_probabilities_.reserve(prefs.size());
+    sampled_receivers_.reserve(prefs.size());
+
     double cumulative_probability = 0.0;
-    for (const auto &rec : prefs_) {
+    for (const auto &rec : prefs) {
         cumulative_probability += rec.second;
-        if (prob <= cumulative_probability) {
-            return rec.first;
-        }
+        cumulative_probabilities_.push_back(cumulative_probability);
+        sampled_receivers_.emplace_back(rec.first);
     }
-    return nullptr;
+    // The rounded sum may fall short of 1, and a draw above it would choose no receiver.
+    if (!cumulative_probabilities_.empty()) {
+        cumulative_probabilities_.back() = 1.0;
+    }
+    sampling_table_stale_ = false;
+}
+
+const ReceiverHandle *ReceiverPreferences::choose_receiver_handle() {
+    if (sampling_table_stale_) {
+        rebuild_sampling_table();
+    }
+
+    double prob = stream_ ? (*stream_)() : probability_generated_();
+    auto it = std::lower_bound(cumulative_probabilities_.begin(), cumulative_probabilities_.end(), prob);
+    if (it == cumulative_probabilities_.end()) {
+        return nullptr;
+    }
+    return &sampled_receivers_[it - cumulative_probabilities_.begin()];
+}
+
+IPackageReceiver *ReceiverPreferences::choose_receiver() {
+    const ReceiverHandle *receiver = choose_receiver_handle();
+    return receiver ? receiver->get() : nullptr;
+}
+
+void Worker::start_service(Package&& package, Time start, Time finish) {
+    in_service_.push_back({finish, start, next_order_++, std::move(package)});
+    std::push_heap(in_service_.begin(), in_service_.end(), finishes_later);
+    t_ = start;
 }
 
+
+Worker::InService Worker::finish_service() {
+    std::pop_heap(in_service_.begin(), in_service_.end(), finishes_later);
+    InService entry = std::move(in_service_.back());
+    in_service_.pop_back();
+    return entry;
+}
+
+
 void Worker::do_work(Time t) {
-    if (!buff_ && !queue_->empty()) {
-        buff_ = queue_->pop();
-        t_ = t;
+    while (in_service_.size() < servers_ && !queue_->empty()) {
+        Package package = queue_->pop();
+        metrics_.dequeued(package.get_id());
+        start_service(std::move(package), t, t + std::max<TimeOffset>(processing_time_.next(), 1) - 1);
     }
-    else if (buff_ && (t - t_ + 1 == processing_duration_)) {
-        push_package(Package(buff_->get_id()));
-        buff_.reset();
 
-        if (!queue_->empty()) {
-            buff_ = queue_->pop();
+    while (!in_service_.empty() && in_service_.front().finish <= t && (buff_ ? 1 : 0) + finished_.size() < servers_) {
+        InService entry = finish_service();
+        metrics_.processed(t - entry.start + 1);
+        if (buff_) {
+            finished_.push_back(std::move(entry.package));
+        } else {
+            push_package(std::move(entry.package));
         }
     }
 }
 
-void Ramp::deliver_goods(Time t) {
+
+bool Worker::load_next_finished() {
+    if (buff_ || finished_.empty()) {
+        return false;
+    }
+    push_package(std::move(finished_.front()));
+    finished_.pop_front();
+    return true;
+}
+
+
+std::optional<Package> Worker::take_processing_buffer() {
+    if (in_service_.empty()) {
+        return std::nullopt;
+    }
+    return finish_service().package;
+}
+
+
+void Worker::restore_processing_buffer(std::optional<Package>&& package, Time start) {
+    if (package) {
+        start_service(std::move(*package), start, start + std::max<TimeOffset>(get_processing_duration(), 1) - 1);
+    }
+    t_ = start;
+}
+
+
+void Worker::restore_processing_buffer(Package&& package, Time start, Time finish) {
+    start_service(std::move(package), start, finish);
+}
+
+
+std::optional<Package> Worker::take_finished() {
+    if (finished_.empty()) {
+        return std::nullopt;
+    }
+    std::optional<Package> package = std::move(finished_.front());
+    finished_.pop_front();
+    return package;
+}
+
+void Ramp::deliver_goods(Time t, ElementID package_id) {
+    if (get_next_delivery(t) != t) {
+        return;
+    }
+    if (!delivery_interval_.get_distribution().is_fixed()) {
+        next_delivery_ = t + std::max<TimeOffset>(delivery_interval_.next(), 1);
+    }
     if (!buff_) {
-        buff_ = Package(id_);
-        push_package(Package());
-        t_ = t;
-    } else if (t - t_ == delivery_interval_) {
-        push_package(Package());
+        push_package(package_id == PackageIDAllocator::NO_ID ? Package() : Package(package_id));
+        metrics_.delivered(buff_->get_id());
+        Package::get_payload_arena().on_delivered(buff_->get_id(), id_, t);
     }
-}
\ No newline at end of file
+}
+
+
+Time Ramp::get_next_delivery(Time t) const {
+    if (!delivery_interval_.get_distribution().is_fixed()) {
+        return std::max(t, next_delivery_);
+    }
+    TimeOffset interval = get_delivery_interval();
+    return (t - 1) % interval == 0 ? t : 1 + ((t - 1) / interval + 1) * interval;
+}
+
+
+LatencyHistogram Storehouse::get_lead_times() const {
+    LatencyHistogram lead_times;
+    const PackagePayloadArena& payloads = Package::get_payload_arena();
+    for (const auto& package : *s_) {
+        const PackagePayload* payload = payloads.get(package.get_id());
+        if (payload && payload->stored != PackagePayload::UNKNOWN_TURN) {
+            lead_times.record(static_cast<std::uint64_t>(payload->stored - payload->created));
+        }
+    }
+    return lead_times;
+}
@@ -1,27 +1,36 @@
 #ifndef NODES_HPP
 #define NODES_HPP
 
-#include "types.hxx"
-#include "package.hxx"
-#include "helpers.hxx"
-#include "storage_types.hxx"
+#include "types.hpp"
+#include "package.hpp"
+#include "helpers.hpp"
+#include "storage_types.hpp"
+#include "metrics.hpp"
+#include "distributions.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <utility>
 #include <optional>
 #include <map>
-
-enum class NodeColor {
-    UNVISITED, VISITED, VERIFIED
-};
-
+#include <vector>
 
 enum class ReceiverType {
     STOREHOUSE, WORKER
 };
 
 
+class ReceiverPreferences;
+
+
 class IPackageReceiver {
 public:
+    IPackageReceiver() = default;
+    // Incoming links belong to the receiver's address, so a copy or a moved-to receiver starts without them.
+    IPackageReceiver(const IPackageReceiver&) {}
+    IPackageReceiver& operator=(const IPackageReceiver&) { return *this; }
+
     virtual IPackageStockpile::const_iterator begin() const = 0;
     virtual IPackageStockpile::const_iterator cbegin() const = 0;
     virtual IPackageStockpile::const_iterator end() const = 0;
@@ -31,32 +40,113 @@ public:
     virtual ReceiverType get_receiver_type() = 0;
     virtual ElementID get_id() const = 0;
 
+    // Preferences of the senders linked to this receiver, maintained by ReceiverPreferences.
+    const std::vector<ReceiverPreferences*>& get_senders() const { return senders_; }
+
     virtual ~IPackageReceiver() = default;
+
+protected:
+    // Drops this receiver from every sender; called by the final classes' destructors,
+    // while get_receiver_type() and get_id() still dispatch to them.
+    void unlink_senders();
+
+private:
+    friend class ReceiverPreferences;
+
+    void remove_sender(ReceiverPreferences* preferences);
+
+    std::vector<ReceiverPreferences*> senders_;
+};
+
+
+class Storehouse;
+class Worker;
+
+
+// Receiver resolved to its concrete kind when the link is made, so that passing a package
+// is a switch plus a direct call instead of a chain of virtual calls.
+class ReceiverHandle {
+public:
+    ReceiverHandle(IPackageReceiver* receiver) : receiver_(receiver), type_(receiver->get_receiver_type()) {}
+
+    void receive_package(Package&& p) const;
+    // Whether the receiver can take another package on top of `pending` ones not yet delivered to it.
+    bool has_room(std::size_t pending = 0) const;
+
+    IPackageReceiver* get() const { return receiver_; }
+    ReceiverType get_receiver_type() const { return type_; }
+    Worker* as_worker() const;
+    Storehouse* as_storehouse() const;
+
+private:
+    IPackageReceiver* receiver_;
+    ReceiverType type_;
+};
+
+
+// Orders receivers by kind and ID rather than by address, so that sampling is reproducible between runs.
+struct ReceiverOrder {
+    bool operator()(IPackageReceiver* lhs, IPackageReceiver* rhs) const {
+        if (lhs->get_receiver_type() != rhs->get_receiver_type()) {
+            return lhs->get_receiver_type() < rhs->get_receiver_type();
+        }
+        return lhs->get_id() < rhs->get_id();
+    }
 };
 
 
 class ReceiverPreferences {
 public:
-    using preferences_t = std::map<IPackageReceiver*, double>;
+    using preferences_t = std::map<IPackageReceiver*, double, ReceiverOrder>;
     using const_iterator = preferences_t::const_iterator;
 
-    const_iterator begin() const { return prefs_.begin(); }
-    const_iterator cbegin() const { return prefs_.cbegin(); }
-    const_iterator end() const { return prefs_.end(); }
-    const_iterator cend() const { return prefs_.cend(); }
+    const_iterator begin() const { return get_preferences().begin(); }
+    const_iterator cbegin() const { return get_preferences().cbegin(); }
+    const_iterator end() const { return get_preferences().end(); }
+    const_iterator cend() const { return get_preferences().cend(); }
 
     ReceiverPreferences(ProbabilityGenerator pg = probability_generator) { probability_generated_ = std::move(pg); }
+    ReceiverPreferences(ReceiverPreferences&& other) noexcept;
+    ReceiverPreferences& operator=(const ReceiverPreferences&) = delete;
+    ~ReceiverPreferences();
 
-    void add_receiver(IPackageReceiver* r);
+    void add_receiver(IPackageReceiver* r, double weight = 1.0);
     void remove_receiver(IPackageReceiver* r);
 
     IPackageReceiver* choose_receiver();
-
-    const preferences_t& get_preferences() const { return this->prefs_; }
+    const ReceiverHandle* choose_receiver_handle();
+    // Position of a handle given by choose_receiver_handle among the receivers, in preference order.
+    std::size_t index_of(const ReceiverHandle& receiver) const { return static_cast<std::size_t>(&receiver - sampled_receivers_.data()); }
+
+    const preferences_t& get_preferences() const { if (prefs_stale_) { normalize(); } return this->prefs_; }
+    const preferences_t& get_weights() const { return this->weights_; }
+    const ProbabilityGenerator& get_probability_generator() const { return this->probability_generated_; }
+
+    // Draws from its own counter-based stream instead of the probability generator, so the
+    // receivers chosen do not depend on the order in which senders are visited.
+    void use_stream(std::uint64_t seed, std::uint64_t stream) { stream_.emplace(seed, stream); }
+    bool has_stream() const { return stream_.has_value(); }
+    const std::optional<CounterRng>& get_stream() const { return stream_; }
+    std::uint64_t get_stream_counter() const { return stream_ ? stream_->get_counter() : 0; }
+    void set_stream_counter(std::uint64_t counter) { if (stream_) { stream_->set_counter(counter); } }
 
 private:
-    preferences_t prefs_;
+    friend class IPackageReceiver;
+
+    // Probabilities are normalized lazily, so linking n receivers one by one stays O(n log n).
+    void normalize() const;
+    void drop_receiver(IPackageReceiver* r);
+    void rebuild_sampling_table();
+
+    mutable preferences_t prefs_;
+    mutable bool prefs_stale_ = false;
+    preferences_t weights_;
     ProbabilityGenerator probability_generated_;
+    std::optional<CounterRng> stream_;
+
+    bool sampling_table_stale_ = true;
+    std::vector<double> cumulative_probabilities_;
+    std::vector<ReceiverHandle> sampled_receivers_;
 };
 
 
@@ -67,81 +157,229 @@ public:
     PackageSender() = default;
     PackageSender(PackageSender&& moved_element) = default;
 
-    void send_package();
+    // If the chosen receiver is full the package stays in the buffer and the send is retried next turn.
+    IPackageReceiver* send_package();
+
+    // Chooses a receiver and hands the package to stage(receiver handle, package) instead of delivering it;
+    // stage returns false without taking the package if the receiver is full.
+    template<typename StageFunction>
+    IPackageReceiver* send_package(StageFunction&& stage);
     const std::optional<Package>& get_sending_buffer() const { return buff_; }
 
+    std::optional<Package> take_sending_buffer() { std::optional<Package> package = std::move(buff_); buff_.reset(); return package; }
+    void restore_sending_buffer(std::optional<Package>&& package) { buff_ = std::move(package); }
+
+    void attach_metrics(MetricsHandle metrics) { metrics_ = metrics; }
+
 protected:
     std::optional<Package> buff_ = std::nullopt;
+    MetricsHandle metrics_;
 
     void push_package(Package&& package);
 };
 
 
-class Storehouse : public IPackageReceiver {
+template<typename StageFunction>
+IPackageReceiver* PackageSender::send_package(StageFunction&& stage) {
+    if (buff_) {
+        const ReceiverHandle* receiver = receiver_preferences_.choose_receiver_handle();
+        if (receiver && stage(*receiver, std::move(*buff_))) {
+            buff_.reset();
+            metrics_.sent();
+            return receiver->get();
+        }
+        metrics_.blocked();
+    }
+    return nullptr;
+}
+
+
+class Storehouse final : public IPackageReceiver {
 public:
-    Storehouse(ElementID id, std::unique_ptr<IPackageStockpile> s = std::make_unique<PackageQueue>(PackageQueueType::LIFO)) { id_ = id; s_ = std::move(s); }
+    // A capacity of 0 means an unbounded stockpile.
+    Storehouse(ElementID id, std::unique_ptr<IPackageStockpile> s = make_package_queue(PackageQueueType::LIFO), std::size_t capacity = 0)
+        { id_ = id; s_ = std::move(s); ring_ = s_->get_queue_backend() == PackageQueueBackend::RING ? static_cast<RingPackageQueue*>(s_.get()) : nullptr; capacity_ = capacity; }
+    Storehouse(Storehouse&&) = default;
+    ~Storehouse() { unlink_senders(); }
 
     IPackageStockpile::const_iterator begin() const { return s_->begin(); }
     IPackageStockpile::const_iterator cbegin() const { return s_->cbegin(); }
     IPackageStockpile::const_iterator end() const { return s_->end(); }
     IPackageStockpile::const_iterator cend() const { return s_->cend(); }
 
-    void receive_package(Package&& p) { s_->push(std::move(p)); }
+    void receive_package(Package&& p) { metrics_.stored(p.get_id()); Package::get_payload_arena().on_stored(p.get_id()); ring_ ? ring_->push(std::move(p)) : s_->push(std::move(p)); }
     ReceiverType get_receiver_type() { return ReceiverType::STOREHOUSE; }
     ElementID get_id() const { return id_; };
+    IPackageStockpile* get_stockpile() const { return s_.get(); }
+    std::size_t get_capacity() const { return capacity_; }
+    bool has_room(std::size_t pending = 0) const { return capacity_ == 0 || (ring_ ? ring_->size() : s_->size()) + pending < capacity_; }
+    // Turns from delivery at a ramp to arrival here, over the stocked packages that have a payload.
+    LatencyHistogram get_lead_times() const;
+
+    void attach_metrics(MetricsHandle metrics) { metrics_ = metrics; }
 
 private:
     ElementID id_;
     std::unique_ptr<IPackageStockpile> s_;
+    RingPackageQueue* ring_;
+    std::size_t capacity_;
+    MetricsHandle metrics_;
 };
 
 
-class Worker : public PackageSender, public IPackageReceiver {
+class Worker final : public PackageSender, public IPackageReceiver {
 public:
-    Worker(ElementID id, TimeOffset processing_duration, std::unique_ptr<IPackageQueue> queue) { PackageSender(); id_ = id; processing_duration_ = processing_duration; queue_ = std::move(queue); }
+    // A capacity of 0 means an unbounded queue; packages in service do not count towards it.
+    // Up to `servers` packages are processed at once. Finished packages wait for the sending buffer
+    // in order of completion, at most `servers` of them together with it; while that is full a
+    // finished package keeps its server. The processing time is drawn for every package as it starts.
+    Worker(ElementID id, TimeDistribution processing_time, std::unique_ptr<IPackageQueue> queue, std::size_t capacity = 0, std::size_t servers = 1)
+        : processing_time_(std::move(processing_time), WORKER_STREAM | static_cast<std::uint32_t>(id))
+        { PackageSender(); id_ = id; queue_ = std::move(queue); ring_ = queue_->get_queue_backend() == PackageQueueBackend::RING ? static_cast<RingPackageQueue*>(queue_.get()) : nullptr; capacity_ = capacity; servers_ = servers; }
+    Worker(Worker&&) = default;
+    ~Worker() { unlink_senders(); }
 
     void do_work(Time t);
-
-    TimeOffset get_processing_duration() const { return processing_duration_; }
-    Time get_package_processing_start_time() { return t_; }
+    // Moves the next finished package into the sending buffer if it is empty.
+    bool load_next_finished();
+
+    // The fixed processing time, or the mean one when it is drawn.
+    TimeOffset get_processing_duration() const { return processing_time_.get_distribution().get_value(); }
+    const TimeDistribution& get_processing_time_distribution() const { return processing_time_.get_distribution(); }
+    void seed_durations(std::uint64_t seed) { processing_time_.seed(seed); }
+    DurationSampler::Position get_duration_position() const { return processing_time_.get_position(); }
+    void set_duration_position(const DurationSampler::Position& position) { processing_time_.set_position(position); }
+    const DurationSampler& get_duration_sampler() const { return processing_time_; }
+    std::size_t get_servers() const { return servers_; }
+    bool has_free_server() const { return in_service_.size() < servers_; }
+
+    // The package finishing first and its start turn; when no server is busy, the start turn of the last package.
+    Time get_package_processing_start_time() const { return in_service_.empty() ? t_ : in_service_.front().start; }
+    const Package* get_processing_buffer() const { return in_service_.empty() ? nullptr : &in_service_.front().package; }
+    Time get_next_completion() const { return in_service_.front().finish; }
+
+    // visit(package, start, finish) for every package in service, in order of completion.
+    template<typename Visitor>
+    void for_each_in_service(Visitor&& visit) const;
+    const std::deque<Package>& get_finished() const { return finished_; }
+
+    std::optional<Package> take_processing_buffer();
+    // Packages restored one after another finish in the order they were restored in; without
+    // a finish turn the package takes the fixed (or mean) processing time.
+    void restore_processing_buffer(std::optional<Package>&& package, Time start);
+    void restore_processing_buffer(Package&& package, Time start, Time finish);
+    std::optional<Package> take_finished();
+    void restore_finished(Package&& package) { finished_.push_back(std::move(package)); }
 
     IPackageStockpile::const_iterator begin() const { return queue_->begin(); }
     IPackageStockpile::const_iterator cbegin() const { return queue_->cbegin(); }
     IPackageStockpile::const_iterator end() const { return queue_->end(); }
     IPackageStockpile::const_iterator cend() const { return queue_->cend(); }
 
-    void receive_package(Package&& p) { queue_->push(std::move(p)); }
+    void receive_package(Package&& p) { metrics_.enqueued(p.get_id()); Package::get_payload_arena().on_queued(p.get_id(), id_); ring_ ? ring_->push(std::move(p)) : queue_->push(std::move(p)); }
     ReceiverType get_receiver_type() { return ReceiverType::WORKER; }
     ElementID get_id() const { return id_; }
     IPackageQueue* get_queue() const { return queue_.get(); }
+    std::size_t get_capacity() const { return capacity_; }
+    bool has_room(std::size_t pending = 0) const { return capacity_ == 0 || (ring_ ? ring_->size() : queue_->size()) + pending < capacity_; }
 
 private:
+    struct InService {
+        Time finish;
+        Time start;
+        std::uint64_t order;
+        Package package;
+    };
+
+    // Orders the heap so that its front finishes first; ties go to the package started first.
+    static bool finishes_later(const InService& a, const InService& b) { return a.finish != b.finish ? a.finish > b.finish : a.order > b.order; }
+
+    static constexpr std::uint64_t WORKER_STREAM = std::uint64_t(2) << 32;
+
+    void start_service(Package&& package, Time start, Time finish);
+    InService finish_service();
+
     ElementID id_;
-    TimeOffset processing_duration_;
+    DurationSampler processing_time_;
     std::unique_ptr<IPackageQueue> queue_;
-    Time t_;
-
-protected:
-    std::optional<Package> buff_ = std::nullopt;
+    RingPackageQueue* ring_;
+    std::size_t capacity_;
+    std::size_t servers_;
+    Time t_ = 0;
+    std::uint64_t next_order_ = 0;
+    std::vector<InService> in_service_;
+    std::deque<Package> finished_;
 };
 
 
-class Ramp : public PackageSender {
-public:
-    Ramp(ElementID id, TimeOffset delivery_interval) { PackageSender(); id_ = id; delivery_interval_ = delivery_interval; }
+template<typename Visitor>
+void Worker::for_each_in_service(Visitor&& visit) const {
+    std::vector<const InService*> sorted;
+    sorted.reserve(in_service_.size());
+    for (const auto& entry : in_service_) {
+        sorted.push_back(&entry);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const InService* a, const InService* b) { return finishes_later(*b, *a); });
+    for (const InService* entry : sorted) {
+        visit(entry->package, entry->start, entry->finish);
+    }
+}
 
-    void deliver_goods(Time t);
 
-    TimeOffset get_delivery_interval() const { return delivery_interval_; }
+class Ramp : public PackageSender {
+public:
+    // A fixed interval delivers in turns 1, 1 + interval, ...; a drawn one delivers in the first
+    // turn it is asked to and then draws the gap to the next delivery.
+    Ramp(ElementID id, TimeDistribution delivery_interval)
+        : delivery_interval_(std::move(delivery_interval), RAMP_STREAM | static_cast<std::uint32_t>(id)) { PackageSender(); id_ = id; }
+
+    // A delivery falls through while the previous package is still waiting to be sent.
+    void deliver_goods(Time t) { deliver_goods(t, PackageIDAllocator::NO_ID); }
+    // Delivers a package with the given ID instead of a freshly allocated one.
+    void deliver_goods(Time t, ElementID package_id);
+    // The first delivery turn not earlier than t.
+    Time get_next_delivery(Time t) const;
+
+    // The fixed interval, or the mean one when it is drawn.
+    TimeOffset get_delivery_interval() const { return delivery_interval_.get_distribution().get_value(); }
+    const TimeDistribution& get_delivery_interval_distribution() const { return delivery_interval_.get_distribution(); }
     ElementID get_id() const { return id_; }
 
+    void seed_durations(std::uint64_t seed) { delivery_interval_.seed(seed); next_delivery_ = 1; }
+    DurationSampler::Position get_duration_position() const { return delivery_interval_.get_position(); }
+    Time get_drawn_next_delivery() const { return next_delivery_; }
+    const DurationSampler& get_duration_sampler() const { return delivery_interval_; }
+    void restore_durations(Time next_delivery, const DurationSampler::Position& position) { next_delivery_ = next_delivery; delivery_interval_.set_position(position); }
+
 private:
-    ElementID id_;
-    TimeOffset delivery_interval_;
-    Time t_;
+    static constexpr std::uint64_t RAMP_STREAM = std::uint64_t(1) << 32;
 
-protected:
-    std::optional<Package> buff_ = std::nullopt;
+    ElementID id_;
+    DurationSampler delivery_interval_;
+    Time next_delivery_ = 1;
 };
 
-#ENDIF //NODES_HPP
\ No newline at end of file
+inline Worker* ReceiverHandle::as_worker() const {
+    return type_ == ReceiverType::WORKER ? static_cast<Worker*>(receiver_) : nullptr;
+}
+
+inline Storehouse* ReceiverHandle::as_storehouse() const {
+    return type_ == ReceiverType::STOREHOUSE ? static_cast<Storehouse*>(receiver_) : nullptr;
+}
+
+inline bool ReceiverHandle::has_room(std::size_t pending) const {
+    return type_ == ReceiverType::WORKER ? static_cast<Worker*>(receiver_)->has_room(pending) : static_cast<Storehouse*>(receiver_)->has_room(pending);
+}
+
+inline void ReceiverHandle::receive_package(Package&& p) const {
+    switch (type_) {
+        case ReceiverType::WORKER:
+            static_cast<Worker*>(receiver_)->receive_package(std::move(p));
+            break;
+        case ReceiverType::STOREHOUSE:
+            static_cast<Storehouse*>(receiver_)->receive_package(std::move(p));
+            break;
+    }
+}
+
+#endif //NODES_HPP
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "output_buffer.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+void OutputBuffer::flush() {
+    if (used_ == 0) {
+        return;
+    }
+    if (output_stream_) {
+        output_stream_->write(buffer_.data(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+        return;
+    }
+
+    std::size_t written = 0;
+    while (written < used_) {
+        ssize_t result = ::write(fd_, buffer_.data() + written, used_ - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            used_ = 0;
+            throw std::runtime_error(std::string("Nie udało się zapisać danych: ") + std::strerror(errno));
+        }
+        written += static_cast<std::size_t>(result);
+    }
+    used_ = 0;
+}
+
+
+void OutputBuffer::put(std::string_view text) {
+    while (text.size() > buffer_.size() - used_) {
+        std::size_t part = buffer_.size() - used_;
+        std::memcpy(buffer_.data() + used_, text.data(), part);
+        used_ += part;
+        text.remove_prefix(part);
+        flush();
+    }
+    std::memcpy(buffer_.data() + used_, text.data(), text.size());
+    used_ += text.size();
+}
+
+
+void OutputBuffer::put_fixed(double number, int precision) {
+    if (buffer_.size() - used_ < MAX_NUMBER) {
+        flush();
+    }
+    auto result = std::to_chars(buffer_.data() + used_, buffer_.data() + buffer_.size(), number, std::chars_format::fixed, precision);
+    if (result.ec != std::errc()) {
+        put_number(number);
+        return;
+    }
+    used_ = static_cast<std::size_t>(result.ptr - buffer_.data());
+}
@@ -0,0 +1,48 @@
+#ifndef OUTPUT_BUFFER_HPP
+#define OUTPUT_BUFFER_HPP
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <iostream>
+#include <string_view>
+
+// Fixed output buffer in front of a stream or a file descriptor (written with ::write).
+// Numbers are formatted with std::to_chars, so writing text does not allocate.
+class OutputBuffer {
+public:
+    OutputBuffer(std::ostream& output_stream) : output_stream_(&output_stream) {}
+    OutputBuffer(int fd) : fd_(fd) {}
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void put(std::string_view text);
+    template<typename Number>
+    void put_number(Number number);
+    // Fixed notation with the given number of decimal places.
+    void put_fixed(double number, int precision);
+
+    void flush();
+
+private:
+    static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+    // Longest number: a shortest round-trip double, or a fixed one of up to 15 decimals below 10^15.
+    static constexpr std::size_t MAX_NUMBER = 32;
+
+    std::ostream* output_stream_ = nullptr;
+    int fd_ = -1;
+    std::array<char, BUFFER_SIZE> buffer_;
+    std::size_t used_ = 0;
+};
+
+
+template<typename Number>
+void OutputBuffer::put_number(Number number) {
+    if (buffer_.size() - used_ < MAX_NUMBER) {
+        flush();
+    }
+    auto result = std::to_chars(buffer_.data() + used_, buffer_.data() + buffer_.size(), number);
+    used_ = static_cast<std::size_t>(result.ptr - buffer_.data());
+}
+
+#endif //OUTPUT_BUFFER_HPP
@@ -1,31 +1,21 @@
 #include "package.hpp"
 
-std::set<ElementID> Package::active_IDs = {};
-std::set<ElementID> Package::available_IDs = {};
+PackageIDAllocator Package::id_allocator_;
+PackagePayloadArena Package::payload_arena_;
 
-Package::Package() {
-    if (active_IDs.empty() && available_IDs.empty()) {
-        id_ = 1;
-    } else if (!available_IDs.empty()) {
-        id_ = *available_IDs.begin();
-        available_IDs.erase(available_IDs.begin());
-    } else if (!active_IDs.empty()) {
-        id_ = *active_IDs.rbegin() + 1; 
-    }
-    active_IDs.insert(id_);
-}
+Package::Package() : id_(id_allocator_.acquire()) {}
 
 Package &Package::operator=(Package &&otherPackage) noexcept {
     if (this == &otherPackage)
         return *this;
-    active_IDs.erase(this->id_);
-    available_IDs.insert(this->id_);
+    payload_arena_.on_released(this->id_);
+    id_allocator_.release(this->id_);
     this->id_ = otherPackage.id_;
-    active_IDs.insert(this->id_);
+    otherPackage.id_ = PackageIDAllocator::NO_ID;
     return *this;
 }
 
 Package::~Package() {
-    available_IDs.insert(id_);
-    active_IDs.erase(id_);
+    payload_arena_.on_released(id_);
+    id_allocator_.release(id_);
 }
\ No newline at end of file
@@ -1,19 +1,31 @@
+#ifndef PACKAGE_HPP
+#define PACKAGE_HPP
+
 #include "types.hpp"
-#include <set>
+#include "package_id_allocator.hpp"
+#include "package_payload.hpp"
 
 class Package {
 public:
     Package();
-    Package(ElementID id) { active_IDs.insert(id); id_ = id; }
-    Package(Package&& package) { id_ = package.id_; }
+    Package(ElementID id) : id_(id) { id_allocator_.acquire(id); }
+    Package(Package&& package) noexcept : id_(package.id_) { package.id_ = PackageIDAllocator::NO_ID; }
 
     ElementID get_id() const { return id_; }
 
+    // Hands the ID over to the caller, who becomes responsible for releasing it.
+    ElementID detach() noexcept { ElementID id = id_; id_ = PackageIDAllocator::NO_ID; return id; }
+
     Package& operator=(Package &&otherPackage) noexcept;
     ~Package();
 
+    static PackageIDAllocator& get_id_allocator() { return id_allocator_; }
+    static PackagePayloadArena& get_payload_arena() { return payload_arena_; }
+
 private:
-    static std::set<ElementID> active_IDs;
-    static std::set<ElementID> available_IDs;
+    static PackageIDAllocator id_allocator_;
+    static PackagePayloadArena payload_arena_;
     ElementID id_;
 };
+
+#endif //PACKAGE_HPP
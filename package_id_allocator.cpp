@@ -0,0 +1,276 @@
+#include "package_id_allocator.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+void HierarchicalBitmap::grow(std::size_t pos) {
+    std::size_t words = pos / 64 + 1;
+    if (!levels_.empty() && levels_.front().size() >= words) {
+        return;
+    }
+
+    std::vector<std::uint64_t> bottom = levels_.empty() ? std::vector<std::uint64_t>() : std::move(levels_.front());
+    bottom.resize(std::max(words, 2 * bottom.size()), 0);
+
+    levels_.clear();
+    levels_.push_back(std::move(bottom));
+    while (levels_.back().size() > 1) {
+        const auto& below = levels_.back();
+        std::vector<std::uint64_t> above((below.size() + 63) / 64, 0);
+        for (std::size_t i = 0; i < below.size(); ++i) {
+            if (below[i]) {
+                above[i / 64] |= std::uint64_t(1) << (i % 64);
+            }
+        }
+        levels_.push_back(std::move(above));
+    }
+}
+
+
+void HierarchicalBitmap::set(std::size_t pos) {
+    grow(pos);
+    for (auto& level : levels_) {
+        std::uint64_t& word = level[pos / 64];
+        bool was_empty = (word == 0);
+        word |= std::uint64_t(1) << (pos % 64);
+        if (!was_empty) {
+            return;
+        }
+        pos /= 64;
+    }
+}
+
+
+void HierarchicalBitmap::reset(std::size_t pos) {
+    if (levels_.empty() || pos / 64 >= levels_.front().size()) {
+        return;
+    }
+    for (auto& level : levels_) {
+        std::uint64_t& word = level[pos / 64];
+        word &= ~(std::uint64_t(1) << (pos % 64));
+        if (word != 0) {
+            return;
+        }
+        pos /= 64;
+    }
+}
+
+
+std::size_t HierarchicalBitmap::find_first() const {
+    if (levels_.empty() || levels_.back().front() == 0) {
+        return npos;
+    }
+    std::size_t pos = 0;
+    for (auto level = levels_.rbegin(); level != levels_.rend(); ++level) {
+        pos = pos * 64 + static_cast<std::size_t>(__builtin_ctzll((*level)[pos]));
+    }
+    return pos;
+}
+
+
+PackageIDAllocator::Slot& PackageIDAllocator::ensure_slot(std::uint32_t id) {
+    auto& chunk = chunks_[id >> CHUNK_BITS];
+    Slot* slots = chunk.load(std::memory_order_acquire);
+    if (!slots) {
+        Slot* fresh = new Slot[CHUNK_SIZE];
+        if (chunk.compare_exchange_strong(slots, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            slots = fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    return slots[id & (CHUNK_SIZE - 1)];
+}
+
+
+std::uint32_t PackageIDAllocator::pop_free() {
+    std::uint64_t head = free_head_.load(std::memory_order_acquire);
+    while (true) {
+        auto id = static_cast<std::uint32_t>(head);
+        if (id == NIL) {
+            return NIL;
+        }
+        std::uint64_t next = slot(id).next.load(std::memory_order_relaxed);
+        std::uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+        if (free_head_.compare_exchange_weak(head, new_head, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return id;
+        }
+    }
+}
+
+
+void PackageIDAllocator::push_free(std::uint32_t id) {
+    Slot& s = slot(id);
+    std::uint64_t head = free_head_.load(std::memory_order_relaxed);
+    std::uint64_t new_head;
+    do {
+        s.next.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+        new_head = (((head >> 32) + 1) << 32) | id;
+    } while (!free_head_.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+ElementID PackageIDAllocator::acquire() {
+    if (policy_ == IDReusePolicy::LOWEST_FREE) {
+        return acquire_lowest();
+    }
+
+    while (true) {
+        std::uint32_t id = pop_free();
+        if (id == NIL) {
+            id = next_fresh_.fetch_add(1, std::memory_order_relaxed);
+            if (id >> CHUNK_BITS >= MAX_CHUNKS) {
+                throw std::overflow_error("Wyczerpano pulę identyfikatorów półproduktów");
+            }
+            std::uint8_t expected = FREE;
+            if (ensure_slot(id).state.compare_exchange_strong(expected, ACTIVE, std::memory_order_acq_rel)) {
+                return static_cast<ElementID>(id);
+            }
+            continue;
+        }
+
+        // An ID claimed explicitly while still on the stack is ACTIVE_LISTED; drop the stale entry.
+        Slot& s = slot(id);
+        std::uint8_t state = s.state.load(std::memory_order_acquire);
+        while (state == LISTED || state == ACTIVE_LISTED) {
+            if (s.state.compare_exchange_weak(state, ACTIVE, std::memory_order_acq_rel)) {
+                if (state == LISTED) {
+                    return static_cast<ElementID>(id);
+                }
+                break;
+            }
+        }
+    }
+}
+
+
+void PackageIDAllocator::acquire(ElementID id) {
+    if (id <= NO_ID) {
+        throw std::invalid_argument("Niepoprawny identyfikator półproduktu");
+    }
+    if (policy_ == IDReusePolicy::LOWEST_FREE) {
+        acquire_lowest(id);
+        return;
+    }
+
+    Slot& s = ensure_slot(static_cast<std::uint32_t>(id));
+    std::uint8_t state = s.state.load(std::memory_order_acquire);
+    while (state == FREE || state == LISTED) {
+        std::uint8_t desired = (state == FREE) ? ACTIVE : ACTIVE_LISTED;
+        if (s.state.compare_exchange_weak(state, desired, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+}
+
+
+void PackageIDAllocator::release(ElementID id) {
+    if (id <= NO_ID) {
+        return;
+    }
+    if (policy_ == IDReusePolicy::LOWEST_FREE) {
+        release_lowest(id);
+        return;
+    }
+
+    // An ID that was never handed out may fall in a chunk not allocated yet.
+    auto uid = static_cast<std::uint32_t>(id);
+    Slot* chunk = chunks_[uid >> CHUNK_BITS].load(std::memory_order_acquire);
+    if (!chunk) {
+        return;
+    }
+    Slot& s = chunk[uid & (CHUNK_SIZE - 1)];
+    std::uint8_t state = s.state.load(std::memory_order_acquire);
+    while (state == ACTIVE || state == ACTIVE_LISTED) {
+        if (s.state.compare_exchange_weak(state, LISTED, std::memory_order_acq_rel)) {
+            if (state == ACTIVE) {
+                push_free(uid);
+            }
+            return;
+        }
+    }
+}
+
+
+ElementID PackageIDAllocator::acquire_lowest() {
+    std::lock_guard<std::mutex> lock(lowest_mutex_);
+    std::size_t lowest = released_.find_first();
+    if (lowest == HierarchicalBitmap::npos) {
+        return high_water_++;
+    }
+    released_.reset(lowest);
+    return static_cast<ElementID>(lowest);
+}
+
+
+void PackageIDAllocator::acquire_lowest(ElementID id) {
+    std::lock_guard<std::mutex> lock(lowest_mutex_);
+    released_.reset(static_cast<std::size_t>(id));
+    if (id >= high_water_) {
+        high_water_ = id + 1;
+    }
+}
+
+
+void PackageIDAllocator::release_lowest(ElementID id) {
+    std::lock_guard<std::mutex> lock(lowest_mutex_);
+    if (id < high_water_) {
+        released_.set(static_cast<std::size_t>(id));
+    }
+}
+
+
+void PackageIDAllocator::free_chunks() {
+    for (auto& chunk : chunks_) {
+        delete[] chunk.exchange(nullptr, std::memory_order_acq_rel);
+    }
+}
+
+
+void PackageIDAllocator::reset(IDReusePolicy policy) {
+    free_chunks();
+    free_head_.store(NIL, std::memory_order_relaxed);
+    next_fresh_.store(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(lowest_mutex_);
+    released_.clear();
+    high_water_ = 1;
+    policy_ = policy;
+}
+
+
+ElementID PackageIDAllocator::get_next_fresh() const {
+    if (policy_ == IDReusePolicy::LOWEST_FREE) {
+        return high_water_;
+    }
+    return static_cast<ElementID>(next_fresh_.load(std::memory_order_relaxed));
+}
+
+
+void PackageIDAllocator::begin_restore(IDReusePolicy policy, ElementID next_fresh) {
+    reset(policy);
+    high_water_ = next_fresh;
+    next_fresh_.store(static_cast<std::uint32_t>(next_fresh), std::memory_order_relaxed);
+    restore_tail_ = NIL;
+}
+
+
+void PackageIDAllocator::restore_free(ElementID id) {
+    if (id <= NO_ID) {
+        return;
+    }
+    if (policy_ == IDReusePolicy::LOWEST_FREE) {
+        released_.set(static_cast<std::size_t>(id));
+        return;
+    }
+
+    auto uid = static_cast<std::uint32_t>(id);
+    Slot& s = ensure_slot(uid);
+    s.state.store(LISTED, std::memory_order_relaxed);
+    s.next.store(NIL, std::memory_order_relaxed);
+    if (restore_tail_ == NIL) {
+        free_head_.store(uid, std::memory_order_relaxed);
+    } else {
+        slot(restore_tail_).next.store(uid, std::memory_order_relaxed);
+    }
+    restore_tail_ = uid;
+}
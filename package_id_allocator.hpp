@@ -0,0 +1,142 @@
+#ifndef PACKAGE_ID_ALLOCATOR_HPP
+#define PACKAGE_ID_ALLOCATOR_HPP
+
+#include "types.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum class IDReusePolicy {
+    ANY_FREE, LOWEST_FREE
+};
+
+
+// Multi-level bitmap: a set bit on level l+1 marks a non-zero word on level l,
+// so finding the lowest set bit costs one word per level.
+class HierarchicalBitmap {
+public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    void set(std::size_t pos);
+    void reset(std::size_t pos);
+    std::size_t find_first() const;
+    void clear() { levels_.clear(); }
+
+    template<typename Visitor>
+    void for_each(Visitor&& visit) const;
+
+private:
+    void grow(std::size_t pos);
+
+    std::vector<std::vector<std::uint64_t>> levels_;
+};
+
+
+// ANY_FREE (default): lock-free, O(1) acquire/release through a tagged Treiber stack
+// threaded through per-ID slots; a freed ID is handed out again before a fresh one.
+// LOWEST_FREE: the historic "lowest released ID first, otherwise max+1" order,
+// kept behind a mutex on top of a HierarchicalBitmap.
+class PackageIDAllocator {
+public:
+    static constexpr ElementID NO_ID = 0;
+
+    PackageIDAllocator(IDReusePolicy policy = IDReusePolicy::ANY_FREE) : policy_(policy) {}
+    PackageIDAllocator(const PackageIDAllocator&) = delete;
+    PackageIDAllocator& operator=(const PackageIDAllocator&) = delete;
+
+    ElementID acquire();
+    void acquire(ElementID id);
+    void release(ElementID id);
+
+    IDReusePolicy get_policy() const { return policy_; }
+
+    // Not thread-safe; only call while no packages are alive.
+    void reset(IDReusePolicy policy);
+
+    // Checkpoint support, not thread-safe: the next never-used ID and the released IDs
+    // in the order they will be handed out again (ascending for LOWEST_FREE).
+    ElementID get_next_fresh() const;
+    template<typename Visitor>
+    void for_each_free(Visitor&& visit) const;
+
+    // Resets the allocator (see reset) to the given counter; released IDs are then
+    // appended in reuse order with restore_free.
+    void begin_restore(IDReusePolicy policy, ElementID next_fresh);
+    void restore_free(ElementID id);
+
+    ~PackageIDAllocator() { free_chunks(); }
+
+private:
+    enum SlotState : std::uint8_t {
+        FREE, LISTED, ACTIVE, ACTIVE_LISTED
+    };
+
+    struct Slot {
+        std::atomic<std::uint32_t> next{0};
+        std::atomic<std::uint8_t> state{FREE};
+    };
+
+    static constexpr std::uint32_t NIL = 0;
+    static constexpr std::uint32_t CHUNK_BITS = 16;
+    static constexpr std::uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+    static constexpr std::uint32_t MAX_CHUNKS = 1u << (31 - CHUNK_BITS);
+
+    Slot& slot(std::uint32_t id) const { return chunks_[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)]; }
+    Slot& ensure_slot(std::uint32_t id);
+    std::uint32_t pop_free();
+    void push_free(std::uint32_t id);
+    void free_chunks();
+
+    ElementID acquire_lowest();
+    void acquire_lowest(ElementID id);
+    void release_lowest(ElementID id);
+
+    IDReusePolicy policy_;
+
+    std::array<std::atomic<Slot*>, MAX_CHUNKS> chunks_{};
+    std::atomic<std::uint64_t> free_head_{NIL};
+    std::atomic<std::uint32_t> next_fresh_{1};
+
+    std::mutex lowest_mutex_;
+    HierarchicalBitmap released_;
+    ElementID high_water_ = 1;
+
+    std::uint32_t restore_tail_ = NIL;
+};
+
+
+template<typename Visitor>
+void HierarchicalBitmap::for_each(Visitor&& visit) const {
+    if (levels_.empty()) {
+        return;
+    }
+    const auto& bottom = levels_.front();
+    for (std::size_t word = 0; word < bottom.size(); ++word) {
+        for (std::uint64_t bits = bottom[word]; bits; bits &= bits - 1) {
+            visit(word * 64 + static_cast<std::size_t>(__builtin_ctzll(bits)));
+        }
+    }
+}
+
+
+template<typename Visitor>
+void PackageIDAllocator::for_each_free(Visitor&& visit) const {
+    if (policy_ == IDReusePolicy::LOWEST_FREE) {
+        released_.for_each([&visit](std::size_t id) { visit(static_cast<ElementID>(id)); });
+        return;
+    }
+
+    auto id = static_cast<std::uint32_t>(free_head_.load(std::memory_order_acquire));
+    while (id != NIL) {
+        const Slot& s = slot(id);
+        if (s.state.load(std::memory_order_relaxed) == LISTED) {
+            visit(static_cast<ElementID>(id));
+        }
+        id = s.next.load(std::memory_order_relaxed);
+    }
+}
+
+#endif //PACKAGE_ID_ALLOCATOR_HPP
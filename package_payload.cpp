@@ -0,0 +1,79 @@
+#include "package_payload.hpp"
+
+void PackagePayloadArena::enable(std::size_t route_capacity) {
+    chunks_.clear();
+    route_capacity_ = route_capacity;
+    enabled_ = true;
+}
+
+
+void PackagePayloadArena::disable() {
+    chunks_.clear();
+    enabled_ = false;
+}
+
+
+PackagePayload* PackagePayloadArena::find(ElementID package) const {
+    auto index = static_cast<std::size_t>(package);
+    if (package <= 0 || index / CHUNK_SIZE >= chunks_.size()) {
+        return nullptr;
+    }
+    return &chunks_[index / CHUNK_SIZE].payloads[index % CHUNK_SIZE];
+}
+
+
+const PackagePayload* PackagePayloadArena::get(ElementID package) const {
+    const PackagePayload* payload = find(package);
+    return payload && payload->is_known() ? payload : nullptr;
+}
+
+
+std::vector<ElementID> PackagePayloadArena::get_route(ElementID package) const {
+    std::vector<ElementID> route;
+    const PackagePayload* payload = get(package);
+    if (!payload || route_capacity_ == 0) {
+        return route;
+    }
+    auto index = static_cast<std::size_t>(package);
+    const ElementID* ring = chunks_[index / CHUNK_SIZE].routes.get() + (index % CHUNK_SIZE) * route_capacity_;
+    std::size_t kept = std::min<std::size_t>(payload->hops, route_capacity_);
+    for (std::size_t i = payload->hops - kept; i < payload->hops; ++i) {
+        route.push_back(ring[i % route_capacity_]);
+    }
+    return route;
+}
+
+
+void PackagePayloadArena::stamp(ElementID package, ElementID ramp, Time t) {
+    if (package <= 0) {
+        return;
+    }
+    auto index = static_cast<std::size_t>(package);
+    while (index / CHUNK_SIZE >= chunks_.size()) {
+        Chunk chunk;
+        chunk.payloads.reset(new PackagePayload[CHUNK_SIZE]);
+        if (route_capacity_) {
+            chunk.routes.reset(new ElementID[CHUNK_SIZE * route_capacity_]);
+        }
+        chunks_.push_back(std::move(chunk));
+    }
+
+    PackagePayload& payload = chunks_[index / CHUNK_SIZE].payloads[index % CHUNK_SIZE];
+    payload.origin_ramp = ramp;
+    payload.created = t;
+    payload.stored = PackagePayload::UNKNOWN_TURN;
+    payload.hops = 0;
+}
+
+
+void PackagePayloadArena::record_hop(ElementID package, ElementID worker) {
+    PackagePayload* payload = find(package);
+    if (!payload || !payload->is_known()) {
+        return;
+    }
+    if (route_capacity_) {
+        auto index = static_cast<std::size_t>(package);
+        chunks_[index / CHUNK_SIZE].routes[(index % CHUNK_SIZE) * route_capacity_ + payload->hops % route_capacity_] = worker;
+    }
+    ++payload->hops;
+}
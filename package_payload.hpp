@@ -0,0 +1,74 @@
+#ifndef PACKAGE_PAYLOAD_HPP
+#define PACKAGE_PAYLOAD_HPP
+
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+struct PackagePayload {
+    static constexpr Time UNKNOWN_TURN = std::numeric_limits<Time>::min();
+
+    ElementID origin_ramp = 0;
+    Time created = UNKNOWN_TURN;
+    Time stored = UNKNOWN_TURN;
+    // number of workers the package has been queued at
+    std::uint32_t hops = 0;
+
+    bool is_known() const { return created != UNKNOWN_TURN; }
+};
+
+
+// Payloads of packages delivered by ramps, kept outside the packages in fixed-size chunks indexed
+// by package ID, so a Package stays a bare ID and existing chunks never move when the arena grows.
+// With a route capacity of n the last n workers each package visited are kept as well.
+// The arena only grows in on_delivered, which runs serially; the other hooks touch only the slot
+// of their own package, so workers on a thread pool may call them concurrently.
+// Packages created elsewhere (e.g. restored from a checkpoint) have no payload, and payloads are
+// not part of checkpoints.
+class PackagePayloadArena {
+public:
+    PackagePayloadArena() = default;
+    PackagePayloadArena(const PackagePayloadArena&) = delete;
+    PackagePayloadArena& operator=(const PackagePayloadArena&) = delete;
+
+    // Starts recording, dropping everything recorded before.
+    void enable(std::size_t route_capacity = 0);
+    void disable();
+    bool is_enabled() const { return enabled_; }
+    std::size_t get_route_capacity() const { return route_capacity_; }
+
+    // Sets the turn on_stored records; the factory and the event scheduler call it every turn.
+    void begin_turn(Time t) { turn_ = t; }
+
+    void on_delivered(ElementID package, ElementID ramp, Time t) { if (enabled_) { stamp(package, ramp, t); } }
+    void on_queued(ElementID package, ElementID worker) { if (enabled_) { record_hop(package, worker); } }
+    void on_stored(ElementID package) { if (enabled_) { if (PackagePayload* payload = find(package)) { payload->stored = turn_; } } }
+    void on_released(ElementID package) { if (enabled_) { if (PackagePayload* payload = find(package)) { *payload = PackagePayload(); } } }
+
+    // nullptr if the package has no payload.
+    const PackagePayload* get(ElementID package) const;
+    // Oldest visited worker first; at most the route capacity.
+    std::vector<ElementID> get_route(ElementID package) const;
+
+private:
+    static constexpr std::size_t CHUNK_SIZE = 4096;
+
+    struct Chunk {
+        std::unique_ptr<PackagePayload[]> payloads;
+        std::unique_ptr<ElementID[]> routes;
+    };
+
+    PackagePayload* find(ElementID package) const;
+    void stamp(ElementID package, ElementID ramp, Time t);
+    void record_hop(ElementID package, ElementID worker);
+
+    bool enabled_ = false;
+    std::size_t route_capacity_ = 0;
+    Time turn_ = 0;
+    std::vector<Chunk> chunks_;
+};
+
+#endif //PACKAGE_PAYLOAD_HPP
@@ -0,0 +1,250 @@
+#include "partition.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+constexpr std::size_t REFINEMENT_PASSES = 8;
+
+class DisjointSets {
+public:
+    explicit DisjointSets(std::size_t n) : parent_(n) { std::iota(parent_.begin(), parent_.end(), std::size_t(0)); }
+
+    std::size_t find(std::size_t x) {
+        while (parent_[x] != x) {
+            parent_[x] = parent_[parent_[x]];
+            x = parent_[x];
+        }
+        return x;
+    }
+
+    void unite(std::size_t a, std::size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a != b) {
+            parent_[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+private:
+    std::vector<std::size_t> parent_;
+};
+
+
+// Links between nodes numbered ramps first, then workers, then storehouses, each in iteration order.
+struct NodeGraph {
+    std::size_t ramp_count = 0;
+    std::size_t worker_count = 0;
+    std::size_t node_count = 0;
+    std::vector<std::pair<std::size_t, std::size_t>> links;
+    std::vector<bool> bounded;
+
+    explicit NodeGraph(const Factory& factory) {
+        std::unordered_map<const IPackageReceiver*, std::size_t> receiver_nodes;
+        ramp_count = static_cast<std::size_t>(std::distance(factory.ramp_cbegin(), factory.ramp_cend()));
+        node_count = ramp_count;
+        for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+            receiver_nodes[&*it] = node_count++;
+            bounded.push_back(it->get_capacity() > 0);
+            ++worker_count;
+        }
+        for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+            receiver_nodes[&*it] = node_count++;
+            bounded.push_back(it->get_capacity() > 0);
+        }
+        bounded.insert(bounded.begin(), ramp_count, false);
+
+        std::size_t sender = 0;
+        auto add_links = [&](const ReceiverPreferences& preferences) {
+            for (const auto& link : preferences.get_weights()) {
+                links.emplace_back(sender, receiver_nodes.at(link.first));
+            }
+            ++sender;
+        };
+        for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+            add_links(it->receiver_preferences_);
+        }
+        for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+            add_links(it->receiver_preferences_);
+        }
+    }
+};
+
+
+// Nodes that must share a shard contracted into groups, with the links between groups as a CSR graph.
+struct GroupGraph {
+    std::vector<std::size_t> group_of;
+    std::vector<std::size_t> weight;
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> neighbors;
+    std::vector<std::size_t> link_counts;
+
+    explicit GroupGraph(const NodeGraph& graph) {
+        DisjointSets sets(graph.node_count);
+        for (const auto& link : graph.links) {
+            if (graph.bounded[link.second]) {
+                sets.unite(link.first, link.second);
+            }
+        }
+
+        group_of.resize(graph.node_count);
+        std::vector<std::size_t> group_of_root(graph.node_count, graph.node_count);
+        for (std::size_t node = 0; node < graph.node_count; ++node) {
+            std::size_t root = sets.find(node);
+            if (group_of_root[root] == graph.node_count) {
+                group_of_root[root] = weight.size();
+                weight.push_back(0);
+            }
+            group_of[node] = group_of_root[root];
+            ++weight[group_of[node]];
+        }
+
+        std::vector<std::pair<std::size_t, std::size_t>> edges;
+        edges.reserve(2 * graph.links.size());
+        for (const auto& link : graph.links) {
+            std::size_t a = group_of[link.first];
+            std::size_t b = group_of[link.second];
+            if (a != b) {
+                edges.emplace_back(a, b);
+                edges.emplace_back(b, a);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        offsets.assign(weight.size() + 1, 0);
+        for (std::size_t i = 0; i < edges.size(); ++i) {
+            if (i > 0 && edges[i] == edges[i - 1]) {
+                ++link_counts.back();
+                continue;
+            }
+            neighbors.push_back(edges[i].second);
+            link_counts.push_back(1);
+            ++offsets[edges[i].first + 1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    }
+
+    std::size_t size() const { return weight.size(); }
+};
+
+
+// Groups reached breadth-first from the ramps, followed by any the ramps do not reach.
+std::vector<std::size_t> breadth_first_order(const GroupGraph& groups, const NodeGraph& graph) {
+    std::vector<std::size_t> order;
+    order.reserve(groups.size());
+    std::vector<bool> visited(groups.size(), false);
+    auto visit_from = [&](std::size_t start) {
+        if (visited[start]) {
+            return;
+        }
+        visited[start] = true;
+        std::size_t head = order.size();
+        order.push_back(start);
+        for (; head < order.size(); ++head) {
+            std::size_t group = order[head];
+            for (std::size_t i = groups.offsets[group]; i < groups.offsets[group + 1]; ++i) {
+                if (!visited[groups.neighbors[i]]) {
+                    visited[groups.neighbors[i]] = true;
+                    order.push_back(groups.neighbors[i]);
+                }
+            }
+        }
+    };
+    for (std::size_t ramp = 0; ramp < graph.ramp_count; ++ramp) {
+        visit_from(groups.group_of[ramp]);
+    }
+    for (std::size_t group = 0; group < groups.size(); ++group) {
+        visit_from(group);
+    }
+    return order;
+}
+
+}
+
+
+FactoryPartition partition_factory(const Factory& factory, std::size_t shards, double imbalance) {
+    if (shards == 0) {
+        throw std::invalid_argument("Liczba fragmentów sieci musi być dodatnia");
+    }
+    if (!(imbalance >= 0.0)) {
+        throw std::invalid_argument("Dopuszczalna nierównowaga fragmentów nie może być ujemna");
+    }
+
+    const NodeGraph graph(factory);
+    const GroupGraph groups(graph);
+    const std::vector<std::size_t> order = breadth_first_order(groups, graph);
+
+    std::vector<std::uint32_t> shard_of(groups.size(), 0);
+    std::vector<std::size_t> shard_size(shards, 0);
+    std::size_t placed = 0;
+    for (std::size_t group : order) {
+        auto shard = static_cast<std::uint32_t>(std::min(shards - 1, placed * shards / std::max<std::size_t>(graph.node_count, 1)));
+        shard_of[group] = shard;
+        shard_size[shard] += groups.weight[group];
+        placed += groups.weight[group];
+    }
+
+    auto max_size = static_cast<std::size_t>(std::ceil(static_cast<double>(graph.node_count) / static_cast<double>(shards) * (1.0 + imbalance)));
+    std::vector<std::size_t> links_to(shards, 0);
+    std::vector<std::uint32_t> touched;
+    for (std::size_t pass = 0; pass < REFINEMENT_PASSES; ++pass) {
+        bool moved = false;
+        for (std::size_t group : order) {
+            std::uint32_t current = shard_of[group];
+            for (std::size_t i = groups.offsets[group]; i < groups.offsets[group + 1]; ++i) {
+                std::uint32_t shard = shard_of[groups.neighbors[i]];
+                if (links_to[shard] == 0) {
+                    touched.push_back(shard);
+                }
+                links_to[shard] += groups.link_counts[i];
+            }
+
+            std::uint32_t best = current;
+            std::size_t best_links = links_to[current];
+            for (std::uint32_t shard : touched) {
+                if (links_to[shard] > best_links && shard_size[shard] + groups.weight[group] <= max_size) {
+                    best = shard;
+                    best_links = links_to[shard];
+                }
+            }
+            // A shard is never emptied, so every process keeps some work.
+            if (best != current && shard_size[current] > groups.weight[group]) {
+                shard_size[current] -= groups.weight[group];
+                shard_size[best] += groups.weight[group];
+                shard_of[group] = best;
+                moved = true;
+            }
+
+            for (std::uint32_t shard : touched) {
+                links_to[shard] = 0;
+            }
+            touched.clear();
+        }
+        if (!moved) {
+            break;
+        }
+    }
+
+    FactoryPartition partition;
+    partition.shards = shards;
+    for (std::size_t node = 0; node < graph.node_count; ++node) {
+        std::uint32_t shard = shard_of[groups.group_of[node]];
+        if (node < graph.ramp_count) {
+            partition.ramp_shard.push_back(shard);
+        } else if (node < graph.ramp_count + graph.worker_count) {
+            partition.worker_shard.push_back(shard);
+        } else {
+            partition.storehouse_shard.push_back(shard);
+        }
+    }
+    for (const auto& link : graph.links) {
+        if (shard_of[groups.group_of[link.first]] != shard_of[groups.group_of[link.second]]) {
+            ++partition.cut_links;
+        }
+    }
+    return partition;
+}
@@ -0,0 +1,27 @@
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include "factory.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Assignment of every node to a shard, in the iteration order of each collection.
+struct FactoryPartition {
+    std::size_t shards = 1;
+    std::vector<std::uint32_t> ramp_shard;
+    std::vector<std::uint32_t> worker_shard;
+    std::vector<std::uint32_t> storehouse_shard;
+    // links between nodes of different shards
+    std::size_t cut_links = 0;
+};
+
+
+// Splits the graph into shards of at most (1 + imbalance) times the average number of nodes,
+// keeping the number of cut links low: nodes are laid out in breadth-first order from the ramps,
+// cut into contiguous chunks and then moved greedily across the boundaries while that cuts fewer links.
+// A receiver with a bounded capacity always lands in the shard of all its senders, since whether
+// it has room depends on every package sent to it in the turn (see simulate_sharded).
+FactoryPartition partition_factory(const Factory& factory, std::size_t shards, double imbalance = 0.05);
+
+#endif //PARTITION_HPP
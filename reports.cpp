@@ -0,0 +1,288 @@
+#include "reports.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+template<typename Node, typename Iterator>
+std::vector<const Node*> sorted_by_id(Iterator begin, Iterator end) {
+    std::vector<const Node*> nodes;
+    for (auto it = begin; it != end; ++it) {
+        nodes.push_back(&*it);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const Node* lhs, const Node* rhs) { return lhs->get_id() < rhs->get_id(); });
+    return nodes;
+}
+
+void write_receivers(OutputBuffer& out, const PackageSender& sender) {
+    out.put("  Receivers:\n");
+    for (const auto& [receiver, probability] : sender.receiver_preferences_.get_preferences()) {
+        out.put(receiver->get_receiver_type() == ReceiverType::WORKER ? "    worker #" : "    storehouse #");
+        out.put_number(receiver->get_id());
+        out.put(" (p = ");
+        out.put_fixed(probability, 2);
+        out.put(")\n");
+    }
+}
+
+void write_time(OutputBuffer& out, const TimeDistribution& time) {
+    if (time.is_fixed()) {
+        out.put_number(time.get_value());
+    } else {
+        out.put(time.to_string());
+    }
+}
+
+void write_package(OutputBuffer& out, ElementID id) {
+    if (id == PackageIDAllocator::NO_ID) {
+        out.put("(empty)");
+        return;
+    }
+    out.put("#");
+    out.put_number(id);
+}
+
+
+}
+
+
+IntervalReportNotification::IntervalReportNotification(TimeOffset to) : to_(to) {
+    if (to < 1) {
+        throw std::invalid_argument("Odstęp między raportami musi wynosić co najmniej jedną turę");
+    }
+}
+
+
+TurnSnapshot::TurnSnapshot(const Factory& factory, Time t) : t_(t) {
+    auto workers = sorted_by_id<Worker>(factory.worker_cbegin(), factory.worker_cend());
+    auto storehouses = sorted_by_id<Storehouse>(factory.storehouse_cbegin(), factory.storehouse_cend());
+
+    workers_.reserve(workers.size());
+    for (const Worker* worker : workers) {
+        std::size_t processing_begin = packages_.size();
+        processing_times_.resize(processing_begin);
+        worker->for_each_in_service([this, t](const Package& package, Time start, Time) {
+            packages_.push_back(package.get_id());
+            processing_times_.push_back(t - start + 1);
+        });
+        std::size_t sending_begin = packages_.size();
+        if (const auto& sending = worker->get_sending_buffer()) {
+            packages_.push_back(sending->get_id());
+        }
+        for (const auto& package : worker->get_finished()) {
+            packages_.push_back(package.get_id());
+        }
+        std::size_t queue_begin = packages_.size();
+        for (const auto& package : *worker) {
+            packages_.push_back(package.get_id());
+        }
+        workers_.push_back({worker->get_id(), processing_begin, sending_begin, sending_begin, queue_begin, queue_begin, packages_.size()});
+    }
+
+    storehouses_.reserve(storehouses.size());
+    for (const Storehouse* storehouse : storehouses) {
+        std::size_t begin = packages_.size();
+        for (const auto& package : *storehouse) {
+            packages_.push_back(package.get_id());
+        }
+        storehouses_.push_back({storehouse->get_id(), begin, packages_.size()});
+    }
+}
+
+
+void TurnSnapshot::write_packages(OutputBuffer& out, std::size_t begin, std::size_t end) const {
+    if (begin == end) {
+        out.put("(empty)");
+        return;
+    }
+    for (std::size_t i = begin; i < end; ++i) {
+        if (i != begin) {
+            out.put(", ");
+        }
+        write_package(out, packages_[i]);
+    }
+}
+
+
+void TurnSnapshot::write(OutputBuffer& out) const {
+    out.put("=== [ Turn: ");
+    out.put_number(t_);
+    out.put(" ] ===\n\n== WORKERS ==\n");
+    for (const auto& worker : workers_) {
+        out.put("\nWORKER #");
+        out.put_number(worker.id);
+        out.put("\n  PBuffer: ");
+        if (worker.processing_begin == worker.processing_end) {
+            out.put("(empty)");
+        }
+        for (std::size_t i = worker.processing_begin; i < worker.processing_end; ++i) {
+            if (i != worker.processing_begin) {
+                out.put(", ");
+            }
+            write_package(out, packages_[i]);
+            out.put(" (pt = ");
+            out.put_number(processing_times_[i]);
+            out.put(")");
+        }
+        out.put("\n  Queue: ");
+        write_packages(out, worker.queue_begin, worker.queue_end);
+        out.put("\n  SBuffer: ");
+        write_packages(out, worker.sending_begin, worker.sending_end);
+        out.put("\n");
+    }
+
+    out.put("\n\n== STOREHOUSES ==\n");
+    for (const auto& storehouse : storehouses_) {
+        out.put("\nSTOREHOUSE #");
+        out.put_number(storehouse.id);
+        out.put("\n  Stock: ");
+        write_packages(out, storehouse.stock_begin, storehouse.stock_end);
+        out.put("\n");
+    }
+    out.put("\n");
+}
+
+
+void write_structure_report(const Factory& factory, OutputBuffer& out) {
+    out.put("\n== LOADING RAMPS ==\n");
+    for (const Ramp* ramp : sorted_by_id<Ramp>(factory.ramp_cbegin(), factory.ramp_cend())) {
+        out.put("\nLOADING RAMP #");
+        out.put_number(ramp->get_id());
+        out.put("\n  Delivery interval: ");
+        write_time(out, ramp->get_delivery_interval_distribution());
+        out.put("\n");
+        write_receivers(out, *ramp);
+    }
+
+    out.put("\n\n== WORKERS ==\n");
+    for (const Worker* worker : sorted_by_id<Worker>(factory.worker_cbegin(), factory.worker_cend())) {
+        out.put("\nWORKER #");
+        out.put_number(worker->get_id());
+        out.put("\n  Processing time: ");
+        write_time(out, worker->get_processing_time_distribution());
+        out.put(worker->get_queue()->get_queue_type() == PackageQueueType::FIFO ? "\n  Queue type: FIFO\n" : "\n  Queue type: LIFO\n");
+        if (worker->get_servers() > 1) {
+            out.put("  Servers: ");
+            out.put_number(worker->get_servers());
+            out.put("\n");
+        }
+        if (worker->get_capacity()) {
+            out.put("  Capacity: ");
+            out.put_number(worker->get_capacity());
+            out.put("\n");
+        }
+        write_receivers(out, *worker);
+    }
+
+    out.put("\n\n== STOREHOUSES ==\n");
+    for (const Storehouse* storehouse : sorted_by_id<Storehouse>(factory.storehouse_cbegin(), factory.storehouse_cend())) {
+        out.put("\nSTOREHOUSE #");
+        out.put_number(storehouse->get_id());
+        out.put("\n");
+        if (storehouse->get_capacity()) {
+            out.put("  Capacity: ");
+            out.put_number(storehouse->get_capacity());
+            out.put("\n");
+        }
+    }
+    out.put("\n");
+}
+
+
+void generate_structure_report(const Factory& factory, std::ostream& output_stream) {
+    OutputBuffer out(output_stream);
+    write_structure_report(factory, out);
+    out.flush();
+}
+
+
+void generate_simulation_turn_report(const Factory& factory, std::ostream& output_stream, Time t) {
+    OutputBuffer out(output_stream);
+    TurnSnapshot(factory, t).write(out);
+    out.flush();
+}
+
+
+AsyncReportWriter::AsyncReportWriter(std::ostream& output_stream, std::size_t max_pending)
+    : out_(output_stream), max_pending_(std::max<std::size_t>(max_pending, 1)), thread_([this] { run(); }) {}
+
+
+AsyncReportWriter::AsyncReportWriter(int fd, std::size_t max_pending)
+    : out_(fd), max_pending_(std::max<std::size_t>(max_pending, 1)), thread_([this] { run(); }) {}
+
+
+AsyncReportWriter::~AsyncReportWriter() {
+    try {
+        finish();
+    } catch (...) {
+    }
+}
+
+
+void AsyncReportWriter::rethrow_error() {
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+
+void AsyncReportWriter::submit(TurnSnapshot&& snapshot) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [this] { return pending_.size() < max_pending_ || error_; });
+    rethrow_error();
+    pending_.push_back(std::move(snapshot));
+    ready_cv_.notify_one();
+}
+
+
+void AsyncReportWriter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    ready_cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    rethrow_error();
+}
+
+
+void AsyncReportWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        ready_cv_.wait(lock, [this] { return !pending_.empty() || done_; });
+        if (pending_.empty()) {
+            break;
+        }
+        // The snapshot stays queued while it is written, so it still counts against max_pending;
+        // push_back on a deque does not move the elements already in it.
+        const TurnSnapshot& snapshot = pending_.front();
+        lock.unlock();
+        try {
+            snapshot.write(out_);
+        } catch (...) {
+            lock.lock();
+            error_ = std::current_exception();
+            break;
+        }
+        lock.lock();
+        pending_.pop_front();
+        space_cv_.notify_one();
+
+        if (pending_.empty()) {
+            lock.unlock();
+            try {
+                out_.flush();
+            } catch (...) {
+                lock.lock();
+                error_ = std::current_exception();
+                break;
+            }
+            lock.lock();
+        }
+    }
+    pending_.clear();
+    space_cv_.notify_all();
+}
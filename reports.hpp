@@ -0,0 +1,130 @@
+#ifndef REPORTS_HPP
+#define REPORTS_HPP
+
+#include "factory.hpp"
+#include "output_buffer.hpp"
+#include "types.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+class IntervalReportNotification {
+public:
+    IntervalReportNotification(TimeOffset to);
+
+    bool should_generate_report(Time t) const { return (t - 1) % to_ == 0; }
+
+private:
+    TimeOffset to_;
+};
+
+
+class SpecificTurnsReportNotification {
+public:
+    SpecificTurnsReportNotification(std::set<Time> turns) : turns_(std::move(turns)) {}
+
+    bool should_generate_report(Time t) const { return turns_.count(t) != 0; }
+
+private:
+    std::set<Time> turns_;
+};
+
+
+// Package IDs of every worker and storehouse at the end of a turn, sorted by node ID and stored
+// in one flat array, so taking it is a few copies and the factory may run on meanwhile.
+class TurnSnapshot {
+public:
+    TurnSnapshot(const Factory& factory, Time t);
+
+    void write(OutputBuffer& out) const;
+
+private:
+    struct WorkerState {
+        ElementID id;
+        // packages in service, with their processing times at the same offsets in processing_times_
+        std::size_t processing_begin;
+        std::size_t processing_end;
+        std::size_t sending_begin;
+        std::size_t sending_end;
+        std::size_t queue_begin;
+        std::size_t queue_end;
+    };
+
+    struct StorehouseState {
+        ElementID id;
+        std::size_t stock_begin;
+        std::size_t stock_end;
+    };
+
+    void write_packages(OutputBuffer& out, std::size_t begin, std::size_t end) const;
+
+    Time t_;
+    std::vector<WorkerState> workers_;
+    std::vector<StorehouseState> storehouses_;
+    std::vector<ElementID> packages_;
+    std::vector<TimeOffset> processing_times_;
+};
+
+
+void generate_structure_report(const Factory& factory, std::ostream& output_stream);
+void generate_simulation_turn_report(const Factory& factory, std::ostream& output_stream, Time t);
+
+void write_structure_report(const Factory& factory, OutputBuffer& out);
+
+
+// Formats snapshots on its own thread. At most max_pending snapshots wait to be written;
+// submit blocks beyond that, so a slow sink slows the simulation instead of growing memory.
+// After an error of the sink, submit and finish rethrow it.
+class AsyncReportWriter {
+public:
+    AsyncReportWriter(std::ostream& output_stream, std::size_t max_pending = 4);
+    AsyncReportWriter(int fd, std::size_t max_pending = 4);
+    AsyncReportWriter(const AsyncReportWriter&) = delete;
+    AsyncReportWriter& operator=(const AsyncReportWriter&) = delete;
+    ~AsyncReportWriter();
+
+    void submit(TurnSnapshot&& snapshot);
+    // Writes everything submitted so far and stops the thread.
+    void finish();
+
+private:
+    void run();
+    void rethrow_error();
+
+    OutputBuffer out_;
+    std::size_t max_pending_;
+    std::deque<TurnSnapshot> pending_;
+    bool done_ = false;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable space_cv_;
+    std::thread thread_;
+};
+
+
+// Report function for simulate(): snapshots the turns chosen by the notification and hands
+// them to the writer. In SKIP_IDLE_TURNS and EVENT_DRIVEN modes idle turns are never offered.
+template<typename Notification>
+class TurnReporter {
+public:
+    TurnReporter(Notification notification, AsyncReportWriter& writer) : notification_(std::move(notification)), writer_(writer) {}
+
+    void operator()(Factory& factory, Time t) {
+        if (notification_.should_generate_report(t)) {
+            writer_.submit(TurnSnapshot(factory, t));
+        }
+    }
+
+private:
+    Notification notification_;
+    AsyncReportWriter& writer_;
+};
+
+#endif //REPORTS_HPP
@@ -0,0 +1,549 @@
+#include "sharded_simulation.hpp"
+#include "checkpoint.hpp"
+#include "shared_memory.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// A package crossing shards; order is (sender index << 32) + packages sent before it by that sender
+// in the turn, senders indexed workers first, then ramps - the order of the serial passing phase.
+struct PassedPackage {
+    std::uint32_t receiver;
+    ElementID package;
+    std::uint64_t order;
+};
+
+constexpr std::uint32_t END_OF_TURN = std::numeric_limits<std::uint32_t>::max();
+
+struct StagedPackage {
+    std::uint64_t order;
+    ElementID package;
+};
+
+// Thrown in a shard's process once another one has failed.
+struct ShardAborted {};
+
+
+// Nodes in iteration order; receivers are the workers followed by the storehouses.
+struct ShardLayout {
+    std::vector<Ramp*> ramps;
+    std::vector<Worker*> workers;
+    std::vector<Storehouse*> storehouses;
+    std::vector<IPackageReceiver*> receivers;
+    std::vector<std::uint32_t> receiver_shard;
+    // The receivers of sender i (workers first, then ramps) are targets[target_offsets[i] ..], in the
+    // order of its sampling table, so a chosen ReceiverHandle is resolved by its position in it.
+    std::vector<std::size_t> target_offsets;
+    std::vector<std::uint32_t> targets;
+
+    ShardLayout(Factory& factory, const FactoryPartition& partition) {
+        std::unordered_map<const ReceiverPreferences*, std::uint32_t> sender_shard;
+        for (auto it = factory.ramp_begin(); it != factory.ramp_end(); ++it) {
+            ramps.push_back(&*it);
+        }
+        for (auto it = factory.worker_begin(); it != factory.worker_end(); ++it) {
+            workers.push_back(&*it);
+        }
+        if (partition.ramp_shard.size() != ramps.size() || partition.worker_shard.size() != workers.size()
+            || partition.storehouse_shard.size() != static_cast<std::size_t>(std::distance(factory.storehouse_begin(), factory.storehouse_end()))) {
+            throw std::invalid_argument("Podział nie odpowiada strukturze sieci");
+        }
+
+        for (std::size_t i = 0; i < ramps.size(); ++i) {
+            sender_shard[&ramps[i]->receiver_preferences_] = partition.ramp_shard[i];
+        }
+        for (std::size_t i = 0; i < workers.size(); ++i) {
+            sender_shard[&workers[i]->receiver_preferences_] = partition.worker_shard[i];
+            add_receiver(workers[i], partition.worker_shard[i], workers[i]->get_capacity());
+        }
+        std::size_t storehouse = 0;
+        for (auto it = factory.storehouse_begin(); it != factory.storehouse_end(); ++it) {
+            storehouses.push_back(&*it);
+            add_receiver(&*it, partition.storehouse_shard[storehouse++], it->get_capacity());
+        }
+
+        target_offsets.push_back(0);
+        auto add_targets = [this](const ReceiverPreferences& preferences) {
+            for (const auto& preference : preferences.get_preferences()) {
+                targets.push_back(receiver_index_.at(preference.first));
+            }
+            target_offsets.push_back(targets.size());
+        };
+        for (Worker* worker : workers) {
+            add_targets(worker->receiver_preferences_);
+        }
+        for (Ramp* ramp : ramps) {
+            add_targets(ramp->receiver_preferences_);
+        }
+
+        for (std::uint32_t shard : receiver_shard) {
+            if (shard >= partition.shards) {
+                throw std::invalid_argument("Podział nie odpowiada strukturze sieci");
+            }
+        }
+        for (const auto& sender : sender_shard) {
+            if (sender.second >= partition.shards) {
+                throw std::invalid_argument("Podział nie odpowiada strukturze sieci");
+            }
+        }
+        for (std::size_t i = 0; i < receivers.size(); ++i) {
+            if (!bounded_[i]) {
+                continue;
+            }
+            for (const ReceiverPreferences* sender : receivers[i]->get_senders()) {
+                if (sender_shard.at(sender) != receiver_shard[i]) {
+                    throw std::invalid_argument("Odbiorca o ograniczonej pojemności (ID " + std::to_string(receivers[i]->get_id())
+                                                + ") musi być w jednym fragmencie ze wszystkimi nadawcami");
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<bool> bounded_;
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> receiver_index_;
+
+    void add_receiver(IPackageReceiver* receiver, std::uint32_t shard, std::size_t capacity) {
+        receiver_index_[receiver] = static_cast<std::uint32_t>(receivers.size());
+        receivers.push_back(receiver);
+        receiver_shard.push_back(shard);
+        bounded_.push_back(capacity > 0);
+    }
+};
+
+
+// IDs in the order the allocator hands them out: the released ones, then fresh ones.
+class PackageIDSequence {
+public:
+    explicit PackageIDSequence(const PackageIDAllocator& allocator) : policy_(allocator.get_policy()), next_fresh_(allocator.get_next_fresh()) {
+        allocator.for_each_free([this](ElementID id) { free_.push_back(id); });
+    }
+
+    ElementID operator[](std::uint64_t k) const {
+        return k < free_.size() ? free_[k] : next_fresh_ + static_cast<ElementID>(k - free_.size());
+    }
+
+    // The checkpoint header with the allocator as it is after the first n IDs were handed out.
+    void write_header(CheckpointWriter& writer, const Factory& factory, Time next_turn, std::uint64_t n) const {
+        std::size_t used = static_cast<std::size_t>(std::min<std::uint64_t>(n, free_.size()));
+        writer.write_header(make_checkpoint_header(factory, next_turn, policy_, next_fresh_ + static_cast<ElementID>(n - used), free_.size() - used));
+        for (std::size_t i = used; i < free_.size(); ++i) {
+            writer.write_free_id(free_[i]);
+        }
+    }
+
+private:
+    IDReusePolicy policy_;
+    std::vector<ElementID> free_;
+    ElementID next_fresh_;
+};
+
+
+// Everything the processes share: a flag per ramp telling whether it delivers in the current
+// turn, and a ring for every ordered pair of shards.
+struct ShardChannels {
+    SharedBarrier* barrier;
+    std::uint8_t* delivering;
+    SharedRing<PassedPackage>* rings;
+    std::size_t shards;
+
+    ShardChannels(SharedMemory& memory, std::size_t shards, std::size_t ramp_count, std::size_t ring_capacity) : shards(shards) {
+        barrier = memory.make<SharedBarrier>(shards);
+        delivering = memory.make_array<std::uint8_t>(ramp_count);
+        rings = static_cast<SharedRing<PassedPackage>*>(memory.allocate(shards * shards * sizeof(SharedRing<PassedPackage>), alignof(SharedRing<PassedPackage>)));
+        for (std::size_t i = 0; i < shards * shards; ++i) {
+            new (rings + i) SharedRing<PassedPackage>(memory.make_array<PassedPackage>(ring_capacity), ring_capacity);
+        }
+    }
+
+    static std::size_t space_needed(std::size_t shards, std::size_t ramp_count, std::size_t ring_capacity) {
+        return SharedMemory::space_for<SharedBarrier>() + SharedMemory::space_for<std::uint8_t>(ramp_count)
+               + SharedMemory::space_for<SharedRing<PassedPackage>>(shards * shards)
+               + shards * shards * SharedMemory::space_for<PassedPackage>(ring_capacity);
+    }
+
+    SharedRing<PassedPackage>& ring(std::size_t from, std::size_t to) { return rings[from * shards + to]; }
+};
+
+
+// The turns of one shard; mirrors simulate() and Factory's serial phases for its own nodes.
+class ShardProcess {
+public:
+    ShardProcess(Factory& factory, const ShardLayout& layout, const FactoryPartition& partition, ShardChannels& channels,
+                 const PackageIDSequence& ids, std::uint32_t shard)
+        : factory_(factory), layout_(layout), channels_(channels), ids_(ids), shard_(shard),
+          staged_(layout.receivers.size()), ended_(channels.shards, false) {
+        for (std::size_t i = 0; i < layout.ramps.size(); ++i) {
+            if (partition.ramp_shard[i] == shard) {
+                local_ramps_.push_back(i);
+            }
+        }
+        for (std::size_t i = 0; i < layout.workers.size(); ++i) {
+            if (partition.worker_shard[i] == shard) {
+                local_workers_.push_back(i);
+            }
+        }
+        for (std::size_t i = 0; i < layout.receivers.size(); ++i) {
+            if (layout.receiver_shard[i] == shard) {
+                local_receivers_.push_back(i);
+            }
+        }
+    }
+
+    // Writes the records of the shard's own nodes; the first shard writes the checkpoint header before them.
+    void run(TimeOffset d, Time first_turn, std::ostream& output_stream) {
+        for (Time t = first_turn; t < first_turn + d; ++t) {
+            do_deliveries(t);
+            do_package_passing();
+            do_work(t);
+        }
+        CheckpointWriter writer(output_stream);
+        if (shard_ == 0) {
+            ids_.write_header(writer, factory_, first_turn + std::max<TimeOffset>(d, 0), delivered_);
+        }
+        for (std::size_t i : local_ramps_) {
+            writer.write_node(*layout_.ramps[i]);
+        }
+        for (std::size_t i : local_workers_) {
+            writer.write_node(*layout_.workers[i]);
+        }
+        for (std::size_t i : local_receivers_) {
+            if (i >= layout_.workers.size()) {
+                writer.write_node(*layout_.storehouses[i - layout_.workers.size()]);
+            }
+        }
+        writer.finish();
+    }
+
+private:
+    // A package delivered in this turn takes the ID following those of the deliveries at ramps
+    // before it, whichever shard they are in.
+    void do_deliveries(Time t) {
+        for (std::size_t i : local_ramps_) {
+            const Ramp& ramp = *layout_.ramps[i];
+            channels_.delivering[i] = ramp.get_next_delivery(t) == t && !ramp.get_sending_buffer();
+        }
+        if (!channels_.barrier->arrive_and_wait()) {
+            throw ShardAborted();
+        }
+
+        std::uint64_t rank = delivered_;
+        auto local = local_ramps_.begin();
+        for (std::size_t i = 0; i < layout_.ramps.size(); ++i) {
+            if (local != local_ramps_.end() && *local == i) {
+                ++local;
+                if (channels_.delivering[i]) {
+                    layout_.ramps[i]->deliver_goods(t, ids_[rank]);
+                } else {
+                    layout_.ramps[i]->deliver_goods(t);
+                }
+            }
+            rank += channels_.delivering[i];
+        }
+        delivered_ = rank;
+    }
+
+    void do_package_passing() {
+        // Every shard has passed this turn's barrier, so the rings hold only this turn's records. They are
+        // drained while sending too, or two shards sending to each other over full rings would wait forever.
+        std::fill(ended_.begin(), ended_.end(), false);
+        ended_[shard_] = true;
+
+        // Receivers with a bounded capacity are local, as are all the packages they can get.
+        auto stage = [this](const ReceiverHandle& receiver, Package&& package) {
+            std::uint32_t index = layout_.targets[layout_.target_offsets[sender_] + sender_preferences_->index_of(receiver)];
+            std::uint32_t owner = layout_.receiver_shard[index];
+            if (owner == shard_) {
+                std::vector<StagedPackage>& staged = staged_[index];
+                if (!receiver.has_room(staged.size())) {
+                    return false;
+                }
+                staged.push_back({order_, package.detach()});
+            } else {
+                send(owner, {index, package.detach(), order_});
+            }
+            ++order_;
+            return true;
+        };
+        for (std::size_t i : local_workers_) {
+            order_ = static_cast<std::uint64_t>(i) << 32;
+            Worker& worker = *layout_.workers[i];
+            sender_ = i;
+            sender_preferences_ = &worker.receiver_preferences_;
+            while (worker.send_package(stage) && worker.load_next_finished()) {
+            }
+        }
+        for (std::size_t i : local_ramps_) {
+            order_ = static_cast<std::uint64_t>(layout_.workers.size() + i) << 32;
+            sender_ = layout_.workers.size() + i;
+            sender_preferences_ = &layout_.ramps[i]->receiver_preferences_;
+            layout_.ramps[i]->send_package(stage);
+        }
+
+        for (std::uint32_t to = 0; to < channels_.shards; ++to) {
+            if (to != shard_) {
+                send(to, {END_OF_TURN, PackageIDAllocator::NO_ID, 0});
+            }
+        }
+        while (std::find(ended_.begin(), ended_.end(), false) != ended_.end()) {
+            if (!drain_all()) {
+                idle();
+            }
+        }
+
+        for (std::size_t i : local_receivers_) {
+            std::vector<StagedPackage>& staged = staged_[i];
+            std::sort(staged.begin(), staged.end(), [](const StagedPackage& a, const StagedPackage& b) { return a.order < b.order; });
+            for (const auto& package : staged) {
+                layout_.receivers[i]->receive_package(Package(package.package));
+            }
+            staged.clear();
+        }
+    }
+
+    void do_work(Time t) {
+        for (std::size_t i : local_workers_) {
+            layout_.workers[i]->do_work(t);
+        }
+    }
+
+    // While the ring is full the incoming ones are emptied, so two shards sending to each other cannot block.
+    void send(std::uint32_t to, const PassedPackage& record) {
+        while (!channels_.ring(shard_, to).try_push(record)) {
+            if (!drain_all()) {
+                idle();
+            }
+        }
+    }
+
+    // Nothing is read from a shard past its end of turn, which belongs to the next turn's records.
+    bool drain_all() {
+        bool received = false;
+        PassedPackage record;
+        for (std::uint32_t from = 0; from < channels_.shards; ++from) {
+            SharedRing<PassedPackage>& ring = channels_.ring(from, shard_);
+            while (!ended_[from] && ring.try_pop(record)) {
+                received = true;
+                if (record.receiver == END_OF_TURN) {
+                    ended_[from] = true;
+                } else {
+                    staged_[record.receiver].push_back({record.order, record.package});
+                }
+            }
+        }
+        return received;
+    }
+
+    void idle() {
+        if (channels_.barrier->is_aborted()) {
+            throw ShardAborted();
+        }
+        std::this_thread::yield();
+    }
+
+    Factory& factory_;
+    const ShardLayout& layout_;
+    ShardChannels& channels_;
+    const PackageIDSequence& ids_;
+    std::uint32_t shard_;
+
+    std::vector<std::size_t> local_ramps_;
+    std::vector<std::size_t> local_workers_;
+    std::vector<std::size_t> local_receivers_;
+    std::vector<std::vector<StagedPackage>> staged_;
+    std::vector<bool> ended_;
+    std::uint64_t order_ = 0;
+    std::uint64_t delivered_ = 0;
+    // the sender whose packages are being staged
+    std::size_t sender_ = 0;
+    const ReceiverPreferences* sender_preferences_ = nullptr;
+};
+
+
+void write_all(int fd, const std::string& data) {
+    std::size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+}
+
+
+// Output of a shard's process: a status byte, then the checkpoint or an error message.
+constexpr char SHARD_SUCCEEDED = 0;
+constexpr char SHARD_FAILED = 1;
+
+[[noreturn]] void run_shard(Factory& factory, const ShardLayout& layout, const FactoryPartition& partition, ShardChannels& channels,
+                            const PackageIDSequence& ids, std::uint32_t shard, TimeOffset d, Time first_turn, int output_fd) {
+    std::string output;
+    int status = 0;
+    try {
+        ShardProcess process(factory, layout, partition, channels, ids, shard);
+        std::ostringstream checkpoint;
+        process.run(d, first_turn, checkpoint);
+        output = SHARD_SUCCEEDED + checkpoint.str();
+    } catch (const ShardAborted&) {
+        _exit(2);
+    } catch (const std::exception& e) {
+        channels.barrier->abort();
+        output = SHARD_FAILED + std::string(e.what());
+        status = 1;
+    }
+    write_all(output_fd, output);
+    _exit(status);
+}
+
+
+struct ShardChild {
+    pid_t pid = -1;
+    int output_fd = -1;
+    std::string output;
+    bool succeeded = false;
+};
+
+// Reads every output to the end; a process that did not succeed aborts the rest.
+void collect_shards(std::vector<ShardChild>& children, SharedBarrier& barrier) {
+    std::vector<pollfd> fds;
+    std::vector<ShardChild*> open;
+    char buffer[1 << 16];
+    while (true) {
+        fds.clear();
+        open.clear();
+        for (auto& child : children) {
+            if (child.output_fd >= 0) {
+                fds.push_back({child.output_fd, POLLIN, 0});
+                open.push_back(&child);
+            }
+        }
+        if (fds.empty()) {
+            return;
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            barrier.abort();
+            throw std::system_error(errno, std::generic_category(), "Nie udało się odczytać wyników fragmentów");
+        }
+
+        for (std::size_t i = 0; i < fds.size(); ++i) {
+            if (!fds[i].revents) {
+                continue;
+            }
+            ShardChild& child = *open[i];
+            ssize_t n = read(child.output_fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                child.output.append(buffer, static_cast<std::size_t>(n));
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            close(child.output_fd);
+            child.output_fd = -1;
+            int status = 0;
+            while (waitpid(child.pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            child.succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0 && !child.output.empty() && child.output[0] == SHARD_SUCCEEDED;
+            if (!child.succeeded) {
+                barrier.abort();
+            }
+        }
+    }
+}
+
+}
+
+
+void simulate_sharded(Factory& factory, TimeOffset d, const FactoryPartition& partition, Time first_turn, std::size_t ring_capacity) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Sieć jest niespójna");
+    }
+    if (!factory.has_routing_streams()) {
+        throw std::logic_error("Symulacja rozproszona wymaga osobnych strumieni losowania odbiorców (Factory::set_routing_seed)");
+    }
+    if (partition.shards == 0) {
+        throw std::invalid_argument("Liczba fragmentów sieci musi być dodatnia");
+    }
+
+    const ShardLayout layout(factory, partition);
+    const PackageIDSequence ids(Package::get_id_allocator());
+    std::size_t capacity = 1;
+    while (capacity < ring_capacity) {
+        capacity <<= 1;
+    }
+    SharedMemory memory(ShardChannels::space_needed(partition.shards, layout.ramps.size(), capacity));
+    ShardChannels channels(memory, partition.shards, layout.ramps.size(), capacity);
+
+    std::vector<ShardChild> children(partition.shards);
+    for (std::uint32_t shard = 0; shard < partition.shards; ++shard) {
+        int fds[2];
+        pid_t pid = -1;
+        if (pipe(fds) == 0) {
+            pid = fork();
+            if (pid < 0) {
+                close(fds[0]);
+                close(fds[1]);
+            }
+        }
+        if (pid < 0) {
+            int error = errno;
+            channels.barrier->abort();
+            children.resize(shard);
+            collect_shards(children, *channels.barrier);
+            throw std::system_error(error, std::generic_category(), "Nie udało się uruchomić procesu fragmentu " + std::to_string(shard));
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            for (std::uint32_t earlier = 0; earlier < shard; ++earlier) {
+                close(children[earlier].output_fd);
+            }
+            run_shard(factory, layout, partition, channels, ids, shard, d, first_turn, fds[1]);
+        }
+        close(fds[1]);
+        children[shard].pid = pid;
+        children[shard].output_fd = fds[0];
+    }
+    collect_shards(children, *channels.barrier);
+
+    for (std::uint32_t shard = 0; shard < partition.shards; ++shard) {
+        const std::string& output = children[shard].output;
+        if (!children[shard].succeeded && !output.empty() && output[0] == SHARD_FAILED) {
+            throw std::runtime_error("Fragment " + std::to_string(shard) + " symulacji: " + output.substr(1));
+        }
+    }
+    for (std::uint32_t shard = 0; shard < partition.shards; ++shard) {
+        if (!children[shard].succeeded) {
+            throw std::runtime_error("Proces fragmentu " + std::to_string(shard) + " symulacji zakończył się nieoczekiwanie");
+        }
+    }
+
+    // Each shard's records are applied as they are read, one output at a time.
+    CheckpointRestorer restorer(factory);
+    for (std::uint32_t shard = 0; shard < partition.shards; ++shard) {
+        std::istringstream checkpoint(children[shard].output.substr(1));
+        std::string().swap(children[shard].output);
+        if (shard == 0) {
+            restorer.restore_header(checkpoint);
+        }
+        restorer.restore_nodes(checkpoint, std::count(partition.ramp_shard.begin(), partition.ramp_shard.end(), shard),
+                               std::count(partition.worker_shard.begin(), partition.worker_shard.end(), shard),
+                               std::count(partition.storehouse_shard.begin(), partition.storehouse_shard.end(), shard));
+    }
+}
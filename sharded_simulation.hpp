@@ -0,0 +1,21 @@
+#ifndef SHARDED_SIMULATION_HPP
+#define SHARDED_SIMULATION_HPP
+
+#include "factory.hpp"
+#include "partition.hpp"
+#include "types.hpp"
+#include <cstddef>
+
+// Runs turns first_turn .. first_turn + d - 1 like simulate() in EVERY_TURN mode, with the nodes of
+// every shard simulated by a process of its own. The processes are forked, so each starts from a
+// copy-on-write copy of the factory. Packages sent across shards travel through shared-memory
+// rings at the end of the passing phase and are handed to their receivers in the order a single
+// process would hand them over; package IDs are taken from the global allocator's sequence.
+// The result is therefore the one simulate() gives for the same seeds. Afterwards every node gets
+// the state of its shard's process, which sends the records of its own nodes in the checkpoint format.
+// Routing must use per-node streams (Factory::set_routing_seed) and every receiver with a bounded
+// capacity must share the shard of all its senders, as partition_factory ensures. Metrics and
+// package payloads are not collected, and no packages may live outside the factory (see restore_checkpoint).
+void simulate_sharded(Factory& factory, TimeOffset d, const FactoryPartition& partition, Time first_turn = 1, std::size_t ring_capacity = 4096);
+
+#endif //SHARDED_SIMULATION_HPP
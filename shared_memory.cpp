@@ -0,0 +1,44 @@
+#include "shared_memory.hpp"
+#include <cerrno>
+#include <system_error>
+#include <thread>
+#include <sys/mman.h>
+
+SharedMemory::SharedMemory(std::size_t size) : size_(size) {
+    memory_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory_ == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "Nie udało się przydzielić pamięci współdzielonej");
+    }
+}
+
+
+SharedMemory::~SharedMemory() {
+    munmap(memory_, size_);
+}
+
+
+void* SharedMemory::allocate(std::size_t size, std::size_t alignment) {
+    std::size_t offset = (used_ + alignment - 1) / alignment * alignment;
+    if (offset + size > size_) {
+        throw std::bad_alloc();
+    }
+    used_ = offset + size;
+    return static_cast<char*>(memory_) + offset;
+}
+
+
+bool SharedBarrier::arrive_and_wait() {
+    std::uint64_t generation = generation_.load(std::memory_order_acquire);
+    if (arrived_.fetch_add(1, std::memory_order_acq_rel) + 1 == participants_) {
+        arrived_.store(0, std::memory_order_relaxed);
+        generation_.store(generation + 1, std::memory_order_release);
+        return !is_aborted();
+    }
+    while (generation_.load(std::memory_order_acquire) == generation) {
+        if (is_aborted()) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return !is_aborted();
+}
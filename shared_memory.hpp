@@ -0,0 +1,99 @@
+#ifndef SHARED_MEMORY_HPP
+#define SHARED_MEMORY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Anonymous shared mapping; processes forked after it is created see the same pages at the same
+// address, so pointers into it stay valid in all of them. Objects are placed one after another
+// and never destroyed, so only trivially destructible ones belong there.
+class SharedMemory {
+public:
+    explicit SharedMemory(std::size_t size);
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+    ~SharedMemory();
+
+    void* allocate(std::size_t size, std::size_t alignment);
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) { return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...); }
+
+    template<typename T>
+    T* make_array(std::size_t n) {
+        T* array = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        for (std::size_t i = 0; i < n; ++i) {
+            new (array + i) T();
+        }
+        return array;
+    }
+
+    // Room for make<T>() or make_array<T>(n), whatever the alignment of what came before.
+    template<typename T>
+    static constexpr std::size_t space_for(std::size_t n = 1) { return n * sizeof(T) + alignof(T); }
+
+private:
+    void* memory_;
+    std::size_t size_;
+    std::size_t used_ = 0;
+};
+
+
+// Single-producer single-consumer ring of trivially copyable records.
+template<typename Record>
+class SharedRing {
+public:
+    // capacity must be a power of two
+    SharedRing(Record* records, std::size_t capacity) : records_(records), mask_(capacity - 1) {}
+
+    bool try_push(const Record& record) {
+        std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        records_[tail & mask_] = record;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(Record& record) {
+        std::uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        record = records_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "atomics shared between processes must be lock-free");
+
+    alignas(64) std::atomic<std::uint64_t> head_{0};
+    alignas(64) std::atomic<std::uint64_t> tail_{0};
+    alignas(64) Record* records_;
+    std::size_t mask_;
+};
+
+
+// Spinning barrier for a fixed number of processes. Once aborted, every wait returns false
+// right away, so the other processes can give up when one of them fails.
+class SharedBarrier {
+public:
+    explicit SharedBarrier(std::size_t participants) : participants_(participants) {}
+
+    bool arrive_and_wait();
+    void abort() { aborted_.store(true, std::memory_order_release); }
+    bool is_aborted() const { return aborted_.load(std::memory_order_acquire); }
+
+private:
+    alignas(64) std::atomic<std::size_t> arrived_{0};
+    alignas(64) std::atomic<std::uint64_t> generation_{0};
+    std::atomic<bool> aborted_{false};
+    std::size_t participants_;
+};
+
+#endif //SHARED_MEMORY_HPP
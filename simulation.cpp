@@ -0,0 +1,24 @@
+#include "simulation.hpp"
+#include <algorithm>
+
+Time next_active_turn(const Factory& factory, Time t) {
+    Time next = std::numeric_limits<Time>::max();
+
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        if (it->get_sending_buffer()) {
+            return t + 1;
+        }
+        next = std::min(next, it->get_next_delivery(t + 1));
+    }
+
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        if (it->get_sending_buffer() || (it->has_free_server() && !it->get_queue()->empty())) {
+            return t + 1;
+        }
+        if (it->get_processing_buffer()) {
+            next = std::min(next, it->get_next_completion());
+        }
+    }
+
+    return next;
+}
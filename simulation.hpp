@@ -0,0 +1,54 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include "event_scheduler.hpp"
+#include "factory.hpp"
+#include "types.hpp"
+#include <limits>
+#include <stdexcept>
+
+enum class SimulationMode {
+    EVERY_TURN, SKIP_IDLE_TURNS, EVENT_DRIVEN
+};
+
+
+struct NoReport {
+    void operator()(Factory&, Time) const {}
+};
+
+
+Time next_active_turn(const Factory& factory, Time t);
+
+
+// Runs turns first_turn .. first_turn + d - 1 (first_turn > 1 resumes a restored checkpoint).
+// The report function is a template parameter so that NoReport inlines away entirely.
+// In SKIP_IDLE_TURNS and EVENT_DRIVEN modes it is only invoked for turns in which something happened.
+template<typename ReportFunction = NoReport>
+void simulate(Factory& factory, TimeOffset d, ReportFunction&& rf = ReportFunction(), SimulationMode mode = SimulationMode::EVERY_TURN, Time first_turn = 1) {
+    if (!factory.is_consistent()) {
+        throw std::logic_error("Sieć jest niespójna");
+    }
+
+    Time last_turn = first_turn + d - 1;
+
+    if (mode == SimulationMode::EVENT_DRIVEN) {
+        EventScheduler scheduler(factory, first_turn);
+        for (Time t = scheduler.next_turn(); t <= last_turn; t = scheduler.next_turn()) {
+            scheduler.run_turn();
+            rf(factory, t);
+        }
+        return;
+    }
+
+    for (Time t = first_turn; t <= last_turn;) {
+        factory.do_deliveries(t);
+        factory.do_package_passing();
+        factory.do_work(t);
+
+        rf(factory, t);
+
+        t = (mode == SimulationMode::SKIP_IDLE_TURNS) ? next_active_turn(factory, t) : t + 1;
+    }
+}
+
+#endif //SIMULATION_HPP
@@ -1,4 +1,5 @@
-#include "storage_types.hxx"
+#include "storage_types.hpp"
+#include <new>
 #include <stdexcept>
 
 Package PackageQueue::pop() {
@@ -17,4 +18,100 @@ Package PackageQueue::pop() {
     };
 
     return get_package();
-}
\ No newline at end of file
+}
+
+
+PackageStockpileIterator::reference PackageStockpileIterator::operator*() const {
+    if (auto ring = std::get_if<RingPosition>(&it_)) {
+        return ring->data[ring->pos & ring->mask];
+    }
+    return *std::get<std::pmr::list<Package>::const_iterator>(it_);
+}
+
+PackageStockpileIterator& PackageStockpileIterator::operator++() {
+    if (auto ring = std::get_if<RingPosition>(&it_)) {
+        ++ring->pos;
+    } else {
+        ++std::get<std::pmr::list<Package>::const_iterator>(it_);
+    }
+    return *this;
+}
+
+bool PackageStockpileIterator::operator==(const PackageStockpileIterator& other) const {
+    auto ring = std::get_if<RingPosition>(&it_);
+    auto other_ring = std::get_if<RingPosition>(&other.it_);
+    if (ring && other_ring) {
+        return ring->data == other_ring->data && ring->pos == other_ring->pos;
+    }
+    return it_.index() == other.it_.index() && std::get<0>(it_) == std::get<0>(other.it_);
+}
+
+
+void RingPackageQueue::push(Package&& package) {
+    if (size_ == capacity_) {
+        grow();
+    }
+    new (slot(size_)) Package(std::move(package));
+    ++size_;
+}
+
+Package RingPackageQueue::pop() {
+    if (empty()) {
+        throw std::out_of_range("Kolejka półproduktów jest pusta");
+    }
+
+    Package* source = nullptr;
+    if (this->type_of_package_queue_ == PackageQueueType::FIFO) {
+        source = slot(0);
+        head_ = (head_ + 1) & (capacity_ - 1);
+    } else if (this->type_of_package_queue_ == PackageQueueType::LIFO) {
+        source = slot(size_ - 1);
+    } else {
+        throw std::invalid_argument("Incorrect package's queue type name");
+    }
+    --size_;
+
+    Package package = std::move(*source);
+    source->~Package();
+    return package;
+}
+
+void RingPackageQueue::grow() {
+    size_t new_capacity = capacity_ * 2;
+    auto new_data = static_cast<Package*>(resource_->allocate(new_capacity * sizeof(Package), alignof(Package)));
+    for (size_t i = 0; i < size_; ++i) {
+        Package* old_slot = slot(i);
+        new (new_data + i) Package(std::move(*old_slot));
+        old_slot->~Package();
+    }
+
+    if (data_ != reinterpret_cast<Package*>(inline_storage_)) {
+        resource_->deallocate(data_, capacity_ * sizeof(Package), alignof(Package));
+    }
+    data_ = new_data;
+    capacity_ = new_capacity;
+    head_ = 0;
+}
+
+void RingPackageQueue::clear() {
+    for (size_t i = 0; i < size_; ++i) {
+        slot(i)->~Package();
+    }
+    head_ = 0;
+    size_ = 0;
+}
+
+RingPackageQueue::~RingPackageQueue() {
+    clear();
+    if (data_ != reinterpret_cast<Package*>(inline_storage_)) {
+        resource_->deallocate(data_, capacity_ * sizeof(Package), alignof(Package));
+    }
+}
+
+
+std::unique_ptr<IPackageQueue> make_package_queue(PackageQueueType type, PackageQueueBackend backend, std::pmr::memory_resource* resource) {
+    if (backend == PackageQueueBackend::LIST) {
+        return std::make_unique<PackageQueue>(type, resource);
+    }
+    return std::make_unique<RingPackageQueue>(type, resource);
+}
@@ -2,8 +2,13 @@
 #define STORAGE_TYPES_HXX
 
 
-#include "package.hxx"
+#include "package.hpp"
+#include <cstddef>
+#include <iterator>
 #include <list>
+#include <memory>
+#include <memory_resource>
+#include <variant>
 #include <iostream>
 
 enum class PackageQueueType {
@@ -11,9 +16,46 @@ enum class PackageQueueType {
     LIFO
 };
 
+enum class PackageQueueBackend {
+    RING,
+    LIST
+};
+
+
+class PackageStockpileIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Package;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Package*;
+    using reference = const Package&;
+
+    struct RingPosition {
+        const Package* data;
+        std::size_t mask;
+        std::size_t pos;
+    };
+
+    PackageStockpileIterator() = default;
+    PackageStockpileIterator(std::pmr::list<Package>::const_iterator it) : it_(it) {}
+    PackageStockpileIterator(RingPosition it) : it_(it) {}
+
+    reference operator*() const;
+    pointer operator->() const { return &**this; }
+    PackageStockpileIterator& operator++();
+    PackageStockpileIterator operator++(int) { PackageStockpileIterator copy = *this; ++*this; return copy; }
+
+    bool operator==(const PackageStockpileIterator& other) const;
+    bool operator!=(const PackageStockpileIterator& other) const { return !(*this == other); }
+
+private:
+    std::variant<std::pmr::list<Package>::const_iterator, RingPosition> it_;
+};
+
+
 class IPackageStockpile {
 public:
-    using const_iterator = std::list<Package>::const_iterator;
+    using const_iterator = PackageStockpileIterator;
 
     virtual void push(Package&& package) = 0;
     virtual const_iterator cbegin() const = 0;
@@ -22,6 +64,8 @@ public:
     virtual const_iterator end() const = 0;
     virtual bool empty() const = 0;
     virtual size_t size() const = 0;
+    virtual void clear() = 0;
+    virtual PackageQueueBackend get_queue_backend() const = 0;
 
     virtual ~IPackageStockpile() = default;
 };
@@ -36,10 +80,11 @@ public:
 };
 
 
-class PackageQueue : public IPackageQueue {
+class PackageQueue final : public IPackageQueue {
 public:
     PackageQueue() = delete;
-    PackageQueue(PackageQueueType type_of_package) : list_of_packages_(), type_of_package_queue_(type_of_package) {}
+    PackageQueue(PackageQueueType type_of_package, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : list_of_packages_(resource), type_of_package_queue_(type_of_package) {}
 
     void push(Package&& package) { this->list_of_packages_.emplace_back(std::move(package)); }
     const_iterator cbegin() const { return this->list_of_packages_.cbegin(); }
@@ -48,15 +93,62 @@ public:
     const_iterator end() const { return this->list_of_packages_.end(); }
     bool empty() const { return this->list_of_packages_.empty(); }
     size_t size() const { return this->list_of_packages_.size(); }
+    void clear() { this->list_of_packages_.clear(); }
 
     Package pop();
     PackageQueueType get_queue_type() const { return this->type_of_package_queue_; }
+    PackageQueueBackend get_queue_backend() const { return PackageQueueBackend::LIST; }
 
     ~PackageQueue() = default;
 
 private:
-    std::list<Package> list_of_packages_;
+    std::pmr::list<Package> list_of_packages_;
+    PackageQueueType type_of_package_queue_;
+};
+
+
+class RingPackageQueue final : public IPackageQueue {
+public:
+    RingPackageQueue() = delete;
+    RingPackageQueue(PackageQueueType type_of_package, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : type_of_package_queue_(type_of_package), resource_(resource) {}
+    RingPackageQueue(const RingPackageQueue&) = delete;
+    RingPackageQueue& operator=(const RingPackageQueue&) = delete;
+
+    void push(Package&& package);
+    const_iterator cbegin() const { return iterator_at(0); }
+    const_iterator begin() const { return iterator_at(0); }
+    const_iterator cend() const { return iterator_at(size_); }
+    const_iterator end() const { return iterator_at(size_); }
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    void clear();
+
+    Package pop();
+    PackageQueueType get_queue_type() const { return this->type_of_package_queue_; }
+    PackageQueueBackend get_queue_backend() const { return PackageQueueBackend::RING; }
+
+    ~RingPackageQueue();
+
+private:
+    static constexpr size_t INLINE_CAPACITY = 16;
+
+    Package* slot(size_t index) const { return data_ + ((head_ + index) & (capacity_ - 1)); }
+    const_iterator iterator_at(size_t index) const { return PackageStockpileIterator::RingPosition{data_, capacity_ - 1, head_ + index}; }
+    void grow();
+
+    alignas(Package) unsigned char inline_storage_[INLINE_CAPACITY * sizeof(Package)];
+    Package* data_ = reinterpret_cast<Package*>(inline_storage_);
+    size_t capacity_ = INLINE_CAPACITY;
+    size_t head_ = 0;
+    size_t size_ = 0;
     PackageQueueType type_of_package_queue_;
+    std::pmr::memory_resource* resource_;
 };
 
+
+// The queue storage comes from resource, which must outlive the queue.
+std::unique_ptr<IPackageQueue> make_package_queue(PackageQueueType type, PackageQueueBackend backend = PackageQueueBackend::RING,
+                                                  std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
 #endif //STORAGE_TYPES_HXX
\ No newline at end of file
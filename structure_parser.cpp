@@ -0,0 +1,422 @@
+#include "structure_parser.hpp"
+#include <algorithm>
+#include <charconv>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+template<typename Value>
+struct Keyword {
+    std::string_view text;
+    Value value;
+};
+
+constexpr Keyword<ElementType> element_keywords[] = {
+        {"LINK", ElementType::LINK},
+        {"LOADING_RAMP", ElementType::RAMP},
+        {"WORKER", ElementType::WORKER},
+        {"STOREHOUSE", ElementType::STOREHOUSE},
+};
+
+constexpr Keyword<PackageQueueType> queue_type_keywords[] = {
+        {"FIFO", PackageQueueType::FIFO},
+        {"LIFO", PackageQueueType::LIFO},
+};
+
+constexpr Keyword<PackageQueueBackend> queue_backend_keywords[] = {
+        {"RING", PackageQueueBackend::RING},
+        {"LIST", PackageQueueBackend::LIST},
+};
+
+constexpr Keyword<ElementType> node_keywords[] = {
+        {"ramp", ElementType::RAMP},
+        {"worker", ElementType::WORKER},
+        {"store", ElementType::STOREHOUSE},
+};
+
+template<typename Value, std::size_t N>
+const Value* lookup(const Keyword<Value> (&table)[N], std::string_view text) {
+    for (const auto& keyword : table) {
+        if (keyword.text == text) {
+            return &keyword.value;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+
+void StructureParser::fail(const std::string& message, std::size_t column) const {
+    throw StructureParseError(message, line_number_, column);
+}
+
+
+const StructureParser::Param* StructureParser::find(std::string_view key) const {
+    for (std::size_t i = param_count_; i > 0; --i) {
+        if (params_[i - 1].key == key) {
+            return &params_[i - 1];
+        }
+    }
+    return nullptr;
+}
+
+
+const StructureParser::Param& StructureParser::require(std::string_view key) const {
+    const Param* param = find(key);
+    if (!param) {
+        fail("brak wymaganego parametru " + std::string(key), 1);
+    }
+    return *param;
+}
+
+
+template<typename Number>
+Number StructureParser::parse_number(std::string_view text, std::size_t column) const {
+    Number value{};
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        fail("niepoprawna liczba: " + std::string(text), column);
+    }
+    return value;
+}
+
+
+template<typename Number>
+Number StructureParser::parse_number(const Param& param) const {
+    return parse_number<Number>(param.value, param.column + param.key.size() + 1);
+}
+
+
+std::size_t StructureParser::parse(std::string_view data, bool final) {
+    std::size_t consumed = 0;
+    while (consumed < data.size()) {
+        std::size_t end = data.find('\n', consumed);
+        if (end == std::string_view::npos) {
+            if (!final) {
+                break;
+            }
+            end = data.size();
+        }
+
+        ++line_number_;
+        std::string_view line = data.substr(consumed, end - consumed);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty() && line.front() != ';') {
+            parse_line(line);
+        }
+        consumed = end < data.size() ? end + 1 : end;
+    }
+    return consumed;
+}
+
+
+void StructureParser::parse_line(std::string_view line) {
+    std::size_t pos = line.find(' ');
+    std::string_view keyword = line.substr(0, pos);
+    const ElementType* elem_type = lookup(element_keywords, keyword);
+    if (!elem_type) {
+        fail("nieznany typ elementu: " + std::string(keyword), 1);
+    }
+
+    param_count_ = 0;
+    while (pos != std::string_view::npos) {
+        std::size_t begin = pos + 1;
+        pos = line.find(' ', begin);
+        std::string_view token = line.substr(begin, pos == std::string_view::npos ? std::string_view::npos : pos - begin);
+        if (token.empty()) {
+            continue;
+        }
+
+        std::size_t equals = token.find('=');
+        if (equals == std::string_view::npos || equals == 0 || equals + 1 == token.size()) {
+            fail("nieprawidłowy format klucz=wartość: " + std::string(token), begin + 1);
+        }
+        if (param_count_ == MAX_PARAMS) {
+            fail("zbyt wiele parametrów", begin + 1);
+        }
+        params_[param_count_++] = {token.substr(0, equals), token.substr(equals + 1), begin + 1};
+    }
+
+    switch (*elem_type) {
+        case ElementType::LINK:
+            add_link();
+            break;
+        case ElementType::WORKER:
+            add_worker();
+            break;
+        case ElementType::STOREHOUSE:
+            add_storehouse();
+            break;
+        case ElementType::RAMP:
+            add_ramp();
+            break;
+    }
+}
+
+
+// A plain number is a fixed time; a drawn one is exp(mean), uniform(min,max), normal(mean,stddev)
+// or empirical(time:weight,...).
+TimeDistribution StructureParser::parse_time(const Param& param) const {
+    std::string_view text = param.value;
+    std::size_t column = param.column + param.key.size() + 1;
+    std::size_t open = text.find('(');
+    if (open == std::string_view::npos) {
+        auto turns = parse_number<TimeOffset>(text, column);
+        if (turns < 1) {
+            fail("czas musi wynosić co najmniej jedną turę: " + std::string(text), column);
+        }
+        return TimeDistribution(turns);
+    }
+    if (text.back() != ')') {
+        fail("niepoprawny rozkład: " + std::string(text), column);
+    }
+
+    struct Argument {
+        std::string_view text;
+        std::size_t column;
+    };
+    std::vector<Argument> arguments;
+    for (std::size_t begin = open + 1; begin < text.size();) {
+        std::size_t end = std::min(text.find(',', begin), text.size() - 1);
+        arguments.push_back({text.substr(begin, end - begin), column + begin});
+        begin = end + 1;
+    }
+    std::string_view name = text.substr(0, open);
+    auto expect_arguments = [&](std::size_t count) {
+        if (arguments.size() != count) {
+            fail("rozkład " + std::string(name) + " wymaga " + std::to_string(count) + " parametrów", column);
+        }
+    };
+
+    try {
+        if (name == "exp") {
+            expect_arguments(1);
+            return TimeDistribution::exponential(parse_number<double>(arguments[0].text, arguments[0].column));
+        }
+        if (name == "uniform") {
+            expect_arguments(2);
+            return TimeDistribution::uniform(parse_number<TimeOffset>(arguments[0].text, arguments[0].column),
+                                             parse_number<TimeOffset>(arguments[1].text, arguments[1].column));
+        }
+        if (name == "normal") {
+            expect_arguments(2);
+            return TimeDistribution::normal(parse_number<double>(arguments[0].text, arguments[0].column),
+                                            parse_number<double>(arguments[1].text, arguments[1].column));
+        }
+        if (name == "empirical") {
+            std::vector<EmpiricalBin> bins;
+            for (const auto& argument : arguments) {
+                std::size_t colon = argument.text.find(':');
+                if (colon == std::string_view::npos) {
+                    fail("oczekiwano czas:waga: " + std::string(argument.text), argument.column);
+                }
+                bins.push_back({parse_number<TimeOffset>(argument.text.substr(0, colon), argument.column),
+                                parse_number<double>(argument.text.substr(colon + 1), argument.column + colon + 1)});
+            }
+            return TimeDistribution::empirical(std::move(bins));
+        }
+    } catch (const std::invalid_argument& e) {
+        fail(e.what(), column);
+    }
+    fail("nieznany rozkład: " + std::string(name), column);
+}
+
+
+// capacity= is optional; without it the queue is unbounded.
+std::size_t StructureParser::parse_capacity() const {
+    const Param* capacity_param = find("capacity");
+    if (!capacity_param) {
+        return 0;
+    }
+    auto capacity = parse_number<std::size_t>(*capacity_param);
+    if (capacity == 0) {
+        fail("pojemność musi być dodatnia", capacity_param->column);
+    }
+    return capacity;
+}
+
+
+// servers= is optional; without it the worker processes one package at a time.
+std::size_t StructureParser::parse_servers() const {
+    const Param* servers_param = find("servers");
+    if (!servers_param) {
+        return 1;
+    }
+    auto servers = parse_number<std::size_t>(*servers_param);
+    if (servers == 0) {
+        fail("liczba stanowisk musi być dodatnia", servers_param->column);
+    }
+    return servers;
+}
+
+
+void StructureParser::add_worker() {
+    const Param& queue_type_param = require("queue-type");
+    const PackageQueueType* queue_type = lookup(queue_type_keywords, queue_type_param.value);
+    if (!queue_type) {
+        fail("nieznany typ kolejki: " + std::string(queue_type_param.value), queue_type_param.column);
+    }
+
+    PackageQueueBackend backend = PackageQueueBackend::RING;
+    if (const Param* backend_param = find("queue-backend")) {
+        const PackageQueueBackend* found = lookup(queue_backend_keywords, backend_param->value);
+        if (!found) {
+            fail("nieznana implementacja kolejki: " + std::string(backend_param->value), backend_param->column);
+        }
+        backend = *found;
+    }
+
+    const Param& id_param = require("id");
+    ElementID id = parse_number<ElementID>(id_param);
+    TimeDistribution processing_time = parse_time(require("processing-time"));
+    if (factory_.find_worker_by_id(id) != factory_.worker_cend()) {
+        fail("powtórzony identyfikator robotnika " + std::to_string(id), id_param.column);
+    }
+    factory_.add_worker(Worker(id, std::move(processing_time), make_package_queue(*queue_type, backend, factory_.get_package_resource()), parse_capacity(), parse_servers()));
+}
+
+
+void StructureParser::add_storehouse() {
+    const Param& id_param = require("id");
+    ElementID id = parse_number<ElementID>(id_param);
+    if (factory_.find_storehouse_by_id(id) != factory_.storehouse_cend()) {
+        fail("powtórzony identyfikator magazynu " + std::to_string(id), id_param.column);
+    }
+    factory_.add_storehouse(Storehouse(id, make_package_queue(PackageQueueType::LIFO, PackageQueueBackend::RING, factory_.get_package_resource()), parse_capacity()));
+}
+
+
+void StructureParser::add_ramp() {
+    const Param& id_param = require("id");
+    ElementID id = parse_number<ElementID>(id_param);
+    TimeDistribution delivery_interval = parse_time(require("delivery-interval"));
+    if (factory_.find_ramp_by_id(id) != factory_.ramp_cend()) {
+        fail("powtórzony identyfikator rampy " + std::to_string(id), id_param.column);
+    }
+    factory_.add_ramp(Ramp(id, std::move(delivery_interval)));
+}
+
+
+void StructureParser::add_link() {
+    auto split_node = [this](const Param& param, ElementType& node_type, ElementID& node_id) {
+        std::size_t value_column = param.column + param.key.size() + 1;
+        std::size_t dash = param.value.find('-');
+        const ElementType* found = dash == std::string_view::npos ? nullptr : lookup(node_keywords, param.value.substr(0, dash));
+        if (!found) {
+            fail("niepoprawny węzeł: " + std::string(param.value), value_column);
+        }
+        node_type = *found;
+        node_id = parse_number<ElementID>(param.value.substr(dash + 1), value_column + dash + 1);
+    };
+
+    const Param& src = require("src");
+    const Param& dest = require("dest");
+    ElementType src_type, dest_type;
+    ElementID src_id, dest_id;
+    split_node(src, src_type, src_id);
+    split_node(dest, dest_type, dest_id);
+
+    double weight = 1.0;
+    if (const Param* weight_param = find("weight")) {
+        weight = parse_number<double>(*weight_param);
+    }
+
+    IPackageReceiver* receiver = nullptr;
+    if (dest_type == ElementType::WORKER) {
+        auto worker = factory_.find_worker_by_id(dest_id);
+        receiver = worker != factory_.worker_end() ? &*worker : nullptr;
+    } else if (dest_type == ElementType::STOREHOUSE) {
+        auto storehouse = factory_.find_storehouse_by_id(dest_id);
+        receiver = storehouse != factory_.storehouse_end() ? &*storehouse : nullptr;
+    }
+    if (!receiver) {
+        fail("nieznany odbiorca: " + std::string(dest.value), dest.column);
+    }
+
+    PackageSender* sender = nullptr;
+    if (src_type == ElementType::RAMP) {
+        auto ramp = factory_.find_ramp_by_id(src_id);
+        sender = ramp != factory_.ramp_end() ? &*ramp : nullptr;
+    } else if (src_type == ElementType::WORKER) {
+        auto worker = factory_.find_worker_by_id(src_id);
+        sender = worker != factory_.worker_end() ? &*worker : nullptr;
+    }
+    if (!sender) {
+        fail("nieznany nadawca: " + std::string(src.value), src.column);
+    }
+
+    try {
+        sender->receiver_preferences_.add_receiver(receiver, weight);
+    } catch (const std::invalid_argument& error) {
+        fail(error.what(), find("weight")->column);
+    }
+}
+
+
+Factory load_factory_structure(std::istream& input_stream, std::shared_ptr<FactoryMemory> memory) {
+    Factory factory(std::move(memory));
+    StructureParser parser(factory);
+
+    constexpr std::size_t CHUNK_SIZE = 1 << 20;
+    std::vector<char> buffer(CHUNK_SIZE);
+    std::size_t pending = 0;
+
+    while (input_stream) {
+        if (pending == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        input_stream.read(buffer.data() + pending, static_cast<std::streamsize>(buffer.size() - pending));
+        std::size_t available = pending + static_cast<std::size_t>(input_stream.gcount());
+
+        std::size_t consumed = parser.parse(std::string_view(buffer.data(), available), !input_stream);
+        pending = available - consumed;
+        std::copy(buffer.begin() + static_cast<std::ptrdiff_t>(consumed), buffer.begin() + static_cast<std::ptrdiff_t>(available), buffer.begin());
+    }
+
+    return factory;
+}
+
+
+Factory load_factory_structure_file(const std::string& path, std::shared_ptr<FactoryMemory> memory) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Nie można otworzyć pliku " + path);
+    }
+
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Nie można odczytać pliku " + path);
+    }
+
+    Factory factory(std::move(memory));
+    auto size = static_cast<std::size_t>(file_stat.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return factory;
+    }
+
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Nie można zmapować pliku " + path);
+    }
+    ::madvise(data, size, MADV_SEQUENTIAL);
+
+    try {
+        StructureParser parser(factory);
+        parser.parse(std::string_view(static_cast<const char*>(data), size), true);
+    } catch (...) {
+        ::munmap(data, size);
+        throw;
+    }
+    ::munmap(data, size);
+    return factory;
+}
@@ -0,0 +1,73 @@
+#ifndef STRUCTURE_PARSER_HPP
+#define STRUCTURE_PARSER_HPP
+
+#include "factory.hpp"
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+class StructureParseError : public std::logic_error {
+public:
+    StructureParseError(const std::string& message, std::size_t line, std::size_t column)
+        : std::logic_error("linia " + std::to_string(line) + ", kolumna " + std::to_string(column) + ": " + message), line_(line), column_(column) {}
+
+    std::size_t get_line() const { return line_; }
+    std::size_t get_column() const { return column_; }
+
+private:
+    std::size_t line_;
+    std::size_t column_;
+};
+
+
+// Single-pass parser for the structure format. Lines are handled as string_views into the
+// caller's buffer, keywords come from static tables and numbers go through std::from_chars,
+// so parsing a line does not allocate (unless it has drawn times).
+class StructureParser {
+public:
+    StructureParser(Factory& factory) : factory_(factory) {}
+
+    // Parses every complete line of data and returns how many bytes were consumed;
+    // with final == true a trailing line without '\n' is parsed as well.
+    std::size_t parse(std::string_view data, bool final);
+
+private:
+    static constexpr std::size_t MAX_PARAMS = 8;
+
+    struct Param {
+        std::string_view key;
+        std::string_view value;
+        std::size_t column;
+    };
+
+    void parse_line(std::string_view line);
+    const Param* find(std::string_view key) const;
+    const Param& require(std::string_view key) const;
+    [[noreturn]] void fail(const std::string& message, std::size_t column) const;
+
+    template<typename Number>
+    Number parse_number(const Param& param) const;
+    template<typename Number>
+    Number parse_number(std::string_view text, std::size_t column) const;
+
+    TimeDistribution parse_time(const Param& param) const;
+    std::size_t parse_capacity() const;
+    std::size_t parse_servers() const;
+
+    void add_link();
+    void add_worker();
+    void add_storehouse();
+    void add_ramp();
+
+    Factory& factory_;
+    std::size_t line_number_ = 0;
+    std::array<Param, MAX_PARAMS> params_;
+    std::size_t param_count_ = 0;
+};
+
+
+Factory load_factory_structure_file(const std::string& path, std::shared_ptr<FactoryMemory> memory = nullptr);
+
+#endif //STRUCTURE_PARSER_HPP
@@ -0,0 +1,109 @@
+#include "structure_writer.hpp"
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+void StructureWriter::write_time(const TimeDistribution& time) {
+    if (time.is_fixed()) {
+        out_.put_number(time.get_value());
+    } else {
+        out_.put(time.to_string());
+    }
+}
+
+
+void StructureWriter::write_links(const PackageSender& sender, std::string_view sender_name, ElementID sender_id) {
+    for (const auto& [receiver, weight] : sender.receiver_preferences_.get_weights()) {
+        out_.put("LINK src=");
+        out_.put(sender_name);
+        out_.put("-");
+        out_.put_number(sender_id);
+        out_.put(receiver->get_receiver_type() == ReceiverType::WORKER ? std::string_view(" dest=worker-") : std::string_view(" dest=store-"));
+        out_.put_number(receiver->get_id());
+        if (weight != 1.0) {
+            out_.put(" weight=");
+            out_.put_number(weight);
+        }
+        out_.put("\n");
+    }
+}
+
+
+void StructureWriter::write(const Factory& factory) {
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        out_.put("LOADING_RAMP id=");
+        out_.put_number(it->get_id());
+        out_.put(" delivery-interval=");
+        write_time(it->get_delivery_interval_distribution());
+        out_.put("\n");
+    }
+
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        const IPackageQueue* queue = it->get_queue();
+        out_.put("WORKER id=");
+        out_.put_number(it->get_id());
+        out_.put(" processing-time=");
+        write_time(it->get_processing_time_distribution());
+        out_.put(queue->get_queue_type() == PackageQueueType::FIFO ? std::string_view(" queue-type=FIFO") : std::string_view(" queue-type=LIFO"));
+        if (queue->get_queue_backend() == PackageQueueBackend::LIST) {
+            out_.put(" queue-backend=LIST");
+        }
+        if (it->get_capacity()) {
+            out_.put(" capacity=");
+            out_.put_number(it->get_capacity());
+        }
+        if (it->get_servers() > 1) {
+            out_.put(" servers=");
+            out_.put_number(it->get_servers());
+        }
+        out_.put("\n");
+    }
+
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        out_.put("STOREHOUSE id=");
+        out_.put_number(it->get_id());
+        if (it->get_capacity()) {
+            out_.put(" capacity=");
+            out_.put_number(it->get_capacity());
+        }
+        out_.put("\n");
+    }
+
+    for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
+        write_links(*it, "ramp", it->get_id());
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        write_links(*it, "worker", it->get_id());
+    }
+    out_.flush();
+}
+
+
+void save_factory_structure(const Factory& factory, std::ostream& output_stream) {
+    StructureWriter writer(output_stream);
+    writer.write(factory);
+    output_stream.flush();
+}
+
+
+void save_factory_structure_fd(const Factory& factory, int fd) {
+    StructureWriter writer(fd);
+    writer.write(factory);
+}
+
+
+void save_factory_structure_file(const Factory& factory, const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Nie można otworzyć pliku " + path);
+    }
+    try {
+        save_factory_structure_fd(factory, fd);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    if (::close(fd) != 0) {
+        throw std::runtime_error("Nie udało się zapisać pliku " + path);
+    }
+}
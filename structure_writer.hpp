@@ -0,0 +1,34 @@
+#ifndef STRUCTURE_WRITER_HPP
+#define STRUCTURE_WRITER_HPP
+
+#include "factory.hpp"
+#include "output_buffer.hpp"
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// Writes the structure format in one pass over the nodes through an OutputBuffer,
+// so writing a line does not allocate (apart from drawn times, which are rare).
+class StructureWriter {
+public:
+    StructureWriter(std::ostream& output_stream) : out_(output_stream) {}
+    StructureWriter(int fd) : out_(fd) {}
+    StructureWriter(const StructureWriter&) = delete;
+    StructureWriter& operator=(const StructureWriter&) = delete;
+
+    // Writes the whole structure and flushes the buffer to the sink.
+    void write(const Factory& factory);
+    void flush() { out_.flush(); }
+
+private:
+    void write_links(const PackageSender& sender, std::string_view sender_name, ElementID sender_id);
+    void write_time(const TimeDistribution& time);
+
+    OutputBuffer out_;
+};
+
+
+void save_factory_structure_fd(const Factory& factory, int fd);
+void save_factory_structure_file(const Factory& factory, const std::string& path);
+
+#endif //STRUCTURE_WRITER_HPP
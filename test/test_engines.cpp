@@ -0,0 +1,258 @@
+#include "checkpoint.hpp"
+#include "factory_generator.hpp"
+#include "flat_factory.hpp"
+#include "partition.hpp"
+#include "sharded_simulation.hpp"
+#include "simulation.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr TimeOffset TURNS = 300;
+constexpr int RAMPS = 4;
+constexpr int WORKERS = 60;
+constexpr int STOREHOUSES = 3;
+
+
+struct Plant {
+    unsigned seed;
+    bool drawn_times;
+};
+
+
+void PrintTo(const Plant& plant, std::ostream* os) {
+    *os << "seed " << plant.seed << (plant.drawn_times ? ", drawn times" : ", fixed times");
+}
+
+
+// Every worker sends to a storehouse, most also to a later worker and some back to an earlier one.
+std::string random_structure(const Plant& plant) {
+    std::mt19937 rng(plant.seed);
+    auto below = [&rng](int n) { return std::uniform_int_distribution<int>(0, n - 1)(rng); };
+    std::ostringstream structure;
+    for (int id = 1; id <= RAMPS; ++id) {
+        int interval = 1 + below(4);
+        structure << "LOADING_RAMP id=" << id << " delivery-interval=";
+        if (plant.drawn_times) {
+            structure << "uniform(1," << 2 * interval << ")\n";
+        } else {
+            structure << interval << "\n";
+        }
+    }
+    for (int id = 1; id <= WORKERS; ++id) {
+        int processing_time = 1 + below(3);
+        structure << "WORKER id=" << id << " processing-time=";
+        if (plant.drawn_times) {
+            structure << "exp(" << processing_time << ")";
+        } else {
+            structure << processing_time;
+        }
+        structure << " queue-type=" << (below(2) ? "FIFO" : "LIFO") << "\n";
+    }
+    for (int id = 1; id <= STOREHOUSES; ++id) {
+        structure << "STOREHOUSE id=" << id << "\n";
+    }
+    for (int id = 1; id <= RAMPS; ++id) {
+        int first = 1 + below(WORKERS);
+        structure << "LINK src=ramp-" << id << " dest=worker-" << first << "\n";
+        structure << "LINK src=ramp-" << id << " dest=worker-" << first % WORKERS + 1 << "\n";
+    }
+    for (int id = 1; id <= WORKERS; ++id) {
+        structure << "LINK src=worker-" << id << " dest=store-" << 1 + below(STOREHOUSES) << "\n";
+        if (id < WORKERS && below(4) != 0) {
+            structure << "LINK src=worker-" << id << " dest=worker-" << id + 1 + below(WORKERS - id) << "\n";
+        }
+        if (id > 1 && below(3) == 0) {
+            structure << "LINK src=worker-" << id << " dest=worker-" << 1 + below(id - 1) << "\n";
+        }
+    }
+    return structure.str();
+}
+
+
+// IDs of the packages held by every node, in iteration order, with the workers' buffers.
+std::string describe(const Factory& factory) {
+    std::ostringstream out;
+    for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
+        out << "S" << it->get_id() << ":";
+        for (const auto& package : *it) {
+            out << package.get_id() << ",";
+        }
+        out << "\n";
+    }
+    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
+        out << "W" << it->get_id() << ":";
+        for (const auto& package : *it) {
+            out << package.get_id() << ",";
+        }
+        if (it->get_processing_buffer()) {
+            out << " p" << it->get_processing_buffer()->get_id() << "@" << it->get_package_processing_start_time();
+        }
+        if (it->get_sending_buffer()) {
+            out << " s" << it->get_sending_buffer()->get_id();
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+
+// The same structure gives the same package IDs only from a fresh allocator, so the factory
+// of the previous run must be gone. The senders copy probability_generator when they are
+// created, and the copies share one stream, seeded anew for every run.
+Factory load(const Plant& plant) {
+    Package::get_id_allocator().reset(IDReusePolicy::ANY_FREE);
+    auto rng = std::make_shared<std::mt19937>(plant.seed);
+    probability_generator = [rng]() { return std::generate_canonical<double, 10>(*rng); };
+    std::istringstream structure(random_structure(plant));
+    Factory factory = load_factory_structure(structure);
+    factory.set_random_seed(plant.seed);
+    return factory;
+}
+
+
+// The state after every turn 1 .. TURNS. Modes that report only the turns in which something
+// happened leave the state of the turns in between equal to that of the last reported one.
+std::vector<std::string> states_by_turn(const Plant& plant, SimulationMode mode) {
+    Factory factory = load(plant);
+    std::vector<std::string> states(TURNS + 1);
+    Time reported = 0;
+    simulate(factory, TURNS, [&](Factory& f, Time t) {
+        for (Time skipped = reported + 1; skipped < t; ++skipped) {
+            states[skipped] = states[reported];
+        }
+        states[t] = describe(f);
+        reported = t;
+    }, mode);
+    for (Time skipped = reported + 1; skipped <= TURNS; ++skipped) {
+        states[skipped] = states[reported];
+    }
+    return states;
+}
+
+
+// The state after run(factory) on a freshly loaded structure.
+template<typename Run>
+std::string final_state(const Plant& plant, Run&& run) {
+    Factory factory = load(plant);
+    run(factory);
+    return describe(factory);
+}
+
+
+void expect_same_turns(const std::vector<std::string>& expected, const std::vector<std::string>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (std::size_t t = 1; t < expected.size(); ++t) {
+        ASSERT_EQ(expected[t], actual[t]) << "turn " << t;
+    }
+}
+
+
+class EnginesTest : public ::testing::TestWithParam<Plant> {};
+
+}
+
+
+TEST_P(EnginesTest, EventDrivenMatchesEveryTurn) {
+    auto expected = states_by_turn(GetParam(), SimulationMode::EVERY_TURN);
+    ASSERT_NE(expected[TURNS], expected[0]);
+    expect_same_turns(expected, states_by_turn(GetParam(), SimulationMode::EVENT_DRIVEN));
+}
+
+TEST_P(EnginesTest, SkipIdleTurnsMatchesEveryTurn) {
+    expect_same_turns(states_by_turn(GetParam(), SimulationMode::EVERY_TURN), states_by_turn(GetParam(), SimulationMode::SKIP_IDLE_TURNS));
+}
+
+TEST_P(EnginesTest, ThreadPoolMatchesSingleThread) {
+    std::string expected = final_state(GetParam(), [](Factory& factory) { simulate(factory, TURNS); });
+    EXPECT_EQ(expected, final_state(GetParam(), [](Factory& factory) {
+        factory.set_thread_pool(std::make_shared<ThreadPool>(3));
+        simulate(factory, TURNS);
+    }));
+}
+
+TEST_P(EnginesTest, FlatFactoryMatchesObjects) {
+    std::string expected = final_state(GetParam(), [](Factory& factory) { simulate(factory, TURNS); });
+    EXPECT_EQ(expected, final_state(GetParam(), [](Factory& factory) { simulate_flat(factory, TURNS); }));
+}
+
+TEST_P(EnginesTest, FlatFactoryFollowsRoutingStreams) {
+    std::string expected = final_state(GetParam(), [](Factory& factory) {
+        factory.set_routing_seed(7);
+        simulate(factory, TURNS);
+    });
+    EXPECT_EQ(expected, final_state(GetParam(), [](Factory& factory) {
+        factory.set_routing_seed(7);
+        simulate_flat(factory, TURNS);
+    }));
+}
+
+// The checkpoint holds the routing and duration streams, but not the shared probability_generator.
+TEST_P(EnginesTest, CheckpointResumesRun) {
+    std::string expected = final_state(GetParam(), [](Factory& factory) {
+        factory.set_routing_seed(7);
+        simulate(factory, TURNS);
+    });
+    std::stringstream checkpoint;
+    final_state(GetParam(), [&checkpoint](Factory& factory) {
+        factory.set_routing_seed(7);
+        simulate(factory, TURNS / 2);
+        save_checkpoint(factory, TURNS / 2 + 1, checkpoint);
+    });
+    EXPECT_EQ(expected, final_state(GetParam(), [&checkpoint](Factory& factory) {
+        factory.set_routing_seed(7);
+        Time next_turn = restore_checkpoint(factory, checkpoint);
+        simulate(factory, TURNS - TURNS / 2, NoReport(), SimulationMode::EVERY_TURN, next_turn);
+    }));
+}
+
+// Sharding needs routing that does not depend on the order senders are visited in.
+TEST_P(EnginesTest, ShardedMatchesSingleProcess) {
+    std::string expected = final_state(GetParam(), [](Factory& factory) {
+        factory.set_routing_seed(7);
+        simulate(factory, TURNS);
+    });
+    for (std::size_t shards : {1, 2, 3}) {
+        EXPECT_EQ(expected, final_state(GetParam(), [shards](Factory& factory) {
+            factory.set_routing_seed(7);
+            simulate_sharded(factory, TURNS, partition_factory(factory, shards));
+        })) << shards << " shards";
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Plants, EnginesTest, ::testing::Values(Plant{1, false}, Plant{2, false}, Plant{3, false},
+                                                                 Plant{1, true}, Plant{2, true}, Plant{3, true}));
+
+
+// Back links send packages both ways between the shards, and rings of two records fill up
+// in almost every turn, so the shards keep waiting on each other.
+TEST(ShardedTest, FullRingsInBothDirections) {
+    FactoryShapeOptions options;
+    options.shape = FactoryShape::RANDOM_GRAPH;
+    options.ramps = 12;
+    options.workers = 300;
+    options.storehouses = 3;
+    options.cycle_probability = 0.6;
+    options.seed = 3;
+    auto run = [&options](auto simulation) {
+        Package::get_id_allocator().reset(IDReusePolicy::ANY_FREE);
+        std::stringstream structure;
+        generate_factory_structure(options, structure);
+        Factory factory = load_factory_structure(structure);
+        factory.set_routing_seed(options.seed);
+        simulation(factory);
+        return describe(factory);
+    };
+
+    std::string expected = run([](Factory& factory) { simulate(factory, TURNS); });
+    EXPECT_EQ(expected, run([](Factory& factory) {
+        FactoryPartition partition = partition_factory(factory, 3);
+        simulate_sharded(factory, TURNS / 2, partition, 1, 2);
+        simulate_sharded(factory, TURNS - TURNS / 2, partition, TURNS / 2 + 1, 2);
+    }));
+}
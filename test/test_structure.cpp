@@ -0,0 +1,134 @@
+#include "factory_generator.hpp"
+#include "structure_parser.hpp"
+#include "structure_writer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+Factory load(const std::string& structure) {
+    std::istringstream input(structure);
+    return load_factory_structure(input);
+}
+
+
+std::string save(const Factory& factory) {
+    std::ostringstream output;
+    save_factory_structure(factory, output);
+    return output.str();
+}
+
+
+// Saving what was loaded from a saved structure must give the same text.
+void expect_round_trip(const std::string& structure) {
+    std::string saved = save(load(structure));
+    EXPECT_EQ(saved, save(load(saved)));
+}
+
+
+// Workers with random times and queues, each linked to a storehouse and to up to two other
+// workers with random weights.
+std::string random_structure(int workers) {
+    std::mt19937 rng(7);
+    auto below = [&rng](int n) { return std::uniform_int_distribution<int>(0, n - 1)(rng); };
+    std::ostringstream structure;
+    structure << "LOADING_RAMP id=1 delivery-interval=2\n";
+    for (int id = 1; id <= workers; ++id) {
+        structure << "WORKER id=" << id << " processing-time=" << 1 + below(20) << " queue-type=" << (below(2) ? "FIFO" : "LIFO") << "\n";
+    }
+    structure << "STOREHOUSE id=1\nSTOREHOUSE id=2\n";
+    structure << "LINK src=ramp-1 dest=worker-1\n";
+    for (int id = 1; id <= workers; ++id) {
+        structure << "LINK src=worker-" << id << " dest=store-" << 1 + below(2) << " weight=" << (1 + below(8)) / 2.0 << "\n";
+        for (int other : {1 + below(workers), 1 + below(workers)}) {
+            if (other != id) {
+                structure << "LINK src=worker-" << id << " dest=worker-" << other << " weight=" << (1 + below(8)) / 2.0 << "\n";
+            }
+        }
+    }
+    return structure.str();
+}
+
+
+class GeneratedStructureTest : public ::testing::TestWithParam<FactoryShape> {};
+
+}
+
+
+TEST(StructureRoundTripTest, RandomStructure) {
+    std::string structure = random_structure(3000);
+    std::string saved = save(load(structure));
+    // one line per node plus the links
+    EXPECT_GT(std::count(saved.begin(), saved.end(), '\n'), 1 + 3000 + 2 + 3000);
+    expect_round_trip(structure);
+}
+
+TEST_P(GeneratedStructureTest, RoundTrip) {
+    FactoryShapeOptions options;
+    options.shape = GetParam();
+    options.ramps = 7;
+    options.workers = 500;
+    options.storehouses = 9;
+    options.fan_out = 3;
+    options.delivery_interval = TimeDistribution::empirical({{1, 0.25}, {4, 0.75}});
+    options.processing_time = TimeDistribution::normal(5, 1.5);
+    std::ostringstream generated;
+    generate_factory_structure(options, generated);
+
+    Factory factory = load(generated.str());
+    EXPECT_TRUE(factory.is_consistent());
+    std::string saved = save(factory);
+    EXPECT_GT(std::count(saved.begin(), saved.end(), '\n'), 7 + 500 + 9);
+    expect_round_trip(generated.str());
+}
+
+INSTANTIATE_TEST_SUITE_P(Shapes, GeneratedStructureTest,
+                         ::testing::Values(FactoryShape::LAYERED, FactoryShape::FAN_OUT, FactoryShape::CHAIN, FactoryShape::RANDOM_GRAPH));
+
+TEST(StructureRoundTripTest, EveryParameter) {
+    std::string structure =
+        "LOADING_RAMP id=1 delivery-interval=3\n"
+        "LOADING_RAMP id=2 delivery-interval=exp(2.5)\n"
+        "WORKER id=1 processing-time=uniform(2,6) queue-type=FIFO capacity=4 servers=2\n"
+        "WORKER id=2 processing-time=2 queue-type=LIFO queue-backend=LIST\n"
+        "STOREHOUSE id=1 capacity=100\n"
+        "STOREHOUSE id=2\n"
+        "LINK src=ramp-1 dest=worker-1 weight=3\n"
+        "LINK src=ramp-1 dest=worker-2\n"
+        "LINK src=ramp-2 dest=worker-2\n"
+        "LINK src=worker-1 dest=worker-2 weight=0.5\n"
+        "LINK src=worker-1 dest=store-1\n"
+        "LINK src=worker-2 dest=store-2\n";
+    Factory factory = load(save(load(structure)));
+    const Worker& worker = *factory.find_worker_by_id(1);
+    EXPECT_EQ(worker.get_processing_time_distribution().to_string(), "uniform(2,6)");
+    EXPECT_EQ(worker.get_queue()->get_queue_type(), PackageQueueType::FIFO);
+    EXPECT_EQ(worker.get_capacity(), 4u);
+    EXPECT_EQ(worker.get_servers(), 2u);
+    EXPECT_EQ(factory.find_worker_by_id(2)->get_queue()->get_queue_backend(), PackageQueueBackend::LIST);
+    EXPECT_EQ(factory.find_storehouse_by_id(1)->get_capacity(), 100u);
+    EXPECT_EQ(factory.find_ramp_by_id(1)->get_delivery_interval(), 3);
+    EXPECT_EQ(factory.find_ramp_by_id(2)->get_delivery_interval_distribution().to_string(), "exp(2.5)");
+    EXPECT_EQ(factory.find_ramp_by_id(1)->receiver_preferences_.get_weights().size(), 2u);
+    expect_round_trip(structure);
+}
+
+TEST(StructureRoundTripTest, FileMatchesStream) {
+    std::string path = (std::filesystem::temp_directory_path() / ("netsim_test_" + std::to_string(::getpid()) + ".txt")).string();
+    Factory factory = load(random_structure(2000));
+    save_factory_structure_file(factory, path);
+    Factory reloaded = load_factory_structure_file(path);
+    std::ifstream file(path);
+    std::string saved((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::remove(path.c_str());
+    EXPECT_EQ(saved, save(factory));
+    EXPECT_EQ(saved, save(reloaded));
+}
@@ -0,0 +1,136 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t threads) : participants_(std::max<std::size_t>(threads, 1)), ranges_(new WorkRange[participants_]) {
+    for (std::size_t i = 1; i < participants_; ++i) {
+        threads_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+
+void ThreadPool::parallel_for(std::size_t n, const RangeFunction& body, std::size_t grain) {
+    grain = std::max<std::size_t>(grain, 1);
+    if (participants_ == 1 || n <= grain) {
+        if (n > 0) {
+            body(0, n);
+        }
+        return;
+    }
+
+    for (std::size_t i = 0; i < participants_; ++i) {
+        ranges_[i].begin = n * i / participants_;
+        ranges_[i].end = n * (i + 1) / participants_;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = &body;
+        grain_ = grain;
+        error_ = nullptr;
+        active_ = participants_ - 1;
+        ++generation_;
+    }
+    start_cv_.notify_all();
+
+    run_ranges(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this]() { return active_ == 0; });
+    body_ = nullptr;
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+
+void ThreadPool::worker_loop(std::size_t index) {
+    std::size_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [&]() { return stopping_ || generation_ != seen_generation; });
+            if (stopping_) {
+                return;
+            }
+            seen_generation = generation_;
+        }
+
+        run_ranges(index);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_ == 0) {
+            done_cv_.notify_one();
+        }
+    }
+}
+
+
+void ThreadPool::run_ranges(std::size_t index) {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    while (take(index, begin, end) || steal(index)) {
+        if (begin == end) {
+            continue;
+        }
+        try {
+            (*body_)(begin, end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        begin = end = 0;
+    }
+}
+
+
+bool ThreadPool::take(std::size_t index, std::size_t& begin, std::size_t& end) {
+    WorkRange& range = ranges_[index];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin >= range.end) {
+        return false;
+    }
+    begin = range.begin;
+    end = std::min(range.begin + grain_, range.end);
+    range.begin = end;
+    return true;
+}
+
+
+bool ThreadPool::steal(std::size_t index) {
+    for (std::size_t k = 1; k < participants_; ++k) {
+        WorkRange& victim = ranges_[(index + k) % participants_];
+        std::size_t begin;
+        std::size_t end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin >= victim.end) {
+                continue;
+            }
+            std::size_t remaining = victim.end - victim.begin;
+            begin = remaining > grain_ ? victim.begin + remaining / 2 : victim.begin;
+            end = victim.end;
+            victim.end = begin;
+        }
+
+        WorkRange& own = ranges_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
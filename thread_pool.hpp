@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool for index ranges. Every participant starts with an equal slice and takes
+// grain-sized chunks from its front; once empty it steals the back half of another slice.
+class ThreadPool {
+public:
+    using RangeFunction = std::function<void(std::size_t begin, std::size_t end)>;
+
+    ThreadPool(std::size_t threads = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const { return participants_; }
+
+    // Blocks until body has been called for every index in [0, n); the caller takes part.
+    void parallel_for(std::size_t n, const RangeFunction& body, std::size_t grain = 64);
+
+    ~ThreadPool();
+
+private:
+    struct alignas(64) WorkRange {
+        std::mutex mutex;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    void worker_loop(std::size_t index);
+    void run_ranges(std::size_t index);
+    bool take(std::size_t index, std::size_t& begin, std::size_t& end);
+    bool steal(std::size_t index);
+
+    std::size_t participants_;
+    std::unique_ptr<WorkRange[]> ranges_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    std::size_t generation_ = 0;
+    std::size_t active_ = 0;
+    bool stopping_ = false;
+    const RangeFunction* body_ = nullptr;
+    std::size_t grain_ = 1;
+    std::exception_ptr error_;
+};
+
+#endif //THREAD_POOL_HPP